@@ -0,0 +1,36 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <vector>
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+
+typedef void (*asset_func)(void* data);
+
+// Runs load functions in the order they were added, on a thread of its own.
+// Whatever a load function fills in belongs to the loader until ready()
+// says so; ready() is a full barrier, so it is then safe on any thread.
+class asset_loader
+{
+  private:
+    std::vector<asset_func> func_list;
+    std::vector<void*> data_list;
+    std::vector<int> ready_list;
+    std::vector<long long> done_usec;   // since start(), when each was ready
+    SDL_Thread* thread;
+    long long start_usec;
+    static int loader_main(void* data);
+    void load_all();
+  public:
+    asset_loader();
+    ~asset_loader();
+    int add(asset_func func, void* data);
+    void start(int threaded);
+    void wait();
+    int ready(int id);
+    int count();
+    int loaded();
+    int usec(int id);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <string>
+#include <vector>
+
+struct SDL_RWops;
+
+///////////////////////////////////
+/*  Pack file layout             */
+///////////////////////////////////
+// All fields are 32-bit little endian. The header, then an index entry per
+// file, then the files, each starting at a multiple of PACK_ALIGN.
+#define PACK_MAGIC      "BPAK"
+#define PACK_VERSION    1
+#define PACK_HEADER     12        // magic, version, entry count
+#define PACK_ENTRY      64        // offset, size, name
+#define PACK_NAME       56        // bytes of name, 0 padded, 0 ended
+#define PACK_ALIGN      16
+
+// The game's files out of one pack, mapped into memory once and served from
+// there without copies. Names are paths as the game opens them, like
+// "data/ship.bmp". A file missing from the pack, or with no pack at all, is
+// read from disk; with loose set, a file on disk is taken before the
+// pack's, so a changed asset is seen without packing again. A pack built
+// into the program is opened from memory the same way.
+class asset_pack
+{
+  private:
+    const unsigned char* base;
+    long size;
+    int mapped;                   // base is to be unmapped on close()
+    std::vector<const char*> names;
+    std::vector<const unsigned char*> datas;
+    std::vector<long> sizes;
+#ifdef PLATFORM_WIN
+    void* file_handle;
+    void* map_handle;
+#endif
+    int read_index();
+    int find(const char* name);
+    int on_disk(const char* name);
+  public:
+    int loose;
+
+    asset_pack();
+    ~asset_pack();
+    int open(const char* path);
+    int open(const void* data, long bytes);
+    void close();
+    int entries();
+    const void* map(const char* name, long& bytes);
+    int exists(const char* name);
+    SDL_RWops* rw(const char* name);
+    void list(const char* dir, const char* ext, std::vector<std::string>& out);
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+///////////////////////////////////
+/*  Atomic int access            */
+///////////////////////////////////
+// GCC __sync builtins. Every access is a full barrier: the ARM926 of the Wiz
+// has no lighter ordering, and on x86 the cost is lost next to a frame.
+inline int atomic_get(volatile int* p)
+{
+  int v=*p;
+  __sync_synchronize();
+  return v;
+}
+
+inline void atomic_set(volatile int* p, int v)
+{
+  __sync_synchronize();
+  *p=v;
+  __sync_synchronize();
+}
+
+// add v, return the new value
+inline int atomic_add(volatile int* p, int v)
+{
+  return __sync_add_and_fetch(p,v);
+}
+
+// store v, return the previous value
+inline int atomic_exchange(volatile int* p, int v)
+{
+  __sync_synchronize();
+  return __sync_lock_test_and_set(p,v);
+}
+
+#endif
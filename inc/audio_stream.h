@@ -0,0 +1,50 @@
+#ifndef AUDIO_STREAM_H
+#define AUDIO_STREAM_H
+
+#include <vector>
+#include "sound_decoder.h"
+
+#define STREAM_FRAMES   8192      // frames decoded ahead, a third of a second at 22 kHz
+#define STREAM_READ     1024      // source frames decoded at once
+
+// A sound played from its file instead of from memory. One thread fill()s
+// a ring of frames already in the output format, the audio callback
+// mix()es them out. A looping stream goes back to the first frame when the
+// decoder runs out, so the loop is seamless; a stream that does not loop
+// can instead be decoded whole with decode_all().
+class audio_stream
+{
+  private:
+    sound_decoder decoder;
+    int loop;
+    int out_channels;             // 1 or 2
+    unsigned int step;            // file frames per output frame, 16.16
+    unsigned int phase;           // position between src frames 0 and 1, 16.16
+    std::vector<int> src;         // file frames as 16-bit stereo, interleaved
+    int src_count;
+    int src_pos;
+    std::vector<short> ring;
+    volatile int write_pos;       // frames written, free running
+    volatile int read_pos;        // frames mixed, free running
+    volatile int playing;
+    volatile int starved;         // written by mix() only
+    int read_source();
+    int convert(short* out, int frames);
+    int start(int rate, int out_ch, int looping);
+  public:
+    audio_stream();
+    ~audio_stream();
+    int open(const char* name, int rate, int out_ch, int looping);
+    int open(const void* data, long size, int rate, int out_ch, int looping);
+    void close();
+    int kind();
+    void fill();
+    int decode_all(std::vector<short>& out);
+    void mix(short* out, int frames, int volume);
+    void play();
+    void stop();
+    int is_playing();
+    int starved_count();
+};
+
+#endif
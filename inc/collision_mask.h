@@ -0,0 +1,32 @@
+#ifndef COLLISION_MASK_H
+#define COLLISION_MASK_H
+
+#include <vector>
+
+#define MASK_MAX_WIDTH  64
+
+typedef unsigned long long mask_row;
+
+// One bit per opaque pixel, one 64-bit word per sprite row (bit x is pixel
+// x). Two sprites overlap if any pair of rows ANDs to non-zero once the
+// second row is shifted by the horizontal distance between them.
+class collision_mask
+{
+  private:
+    int width;
+    int height;
+    std::vector<mask_row> rows;
+  public:
+    collision_mask();
+    ~collision_mask();
+    void create(int w, int h);
+    void set(int x, int y);
+    mask_row row(int y);
+    void set_row(int y, mask_row bits);
+    int w();
+    int h();
+    int empty();
+    int overlap(int x, int y, collision_mask& other, int ox, int oy);
+};
+
+#endif
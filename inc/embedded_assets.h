@@ -0,0 +1,9 @@
+#ifndef EMBEDDED_ASSETS_H
+#define EMBEDDED_ASSETS_H
+
+// A pack compiled into the program, as src/embedded_assets.cpp made by
+// tools/pack_assets -c; only in builds with EMBED_ASSETS.
+extern const unsigned char embedded_pack[];
+extern const long embedded_pack_size;
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef ENTITY_H
+#define ENTITY_H
+
+#include <vector>
+#include "fixed.h"
+
+///////////////////////////////////
+/*  Entity components            */
+///////////////////////////////////
+#define COMP_POS    1   // x, y
+#define COMP_DIR    2   // dir_x, dir_y
+#define COMP_FRAME  4   // frame, vel
+#define COMP_STATE  8   // state
+
+#define ENTITY_NONE -1
+
+// handle layout: generation in the high bits, storage slot in the low 16
+#define ENTITY_SLOT_BITS  16
+#define ENTITY_SLOT_MASK  0xffff
+#define ENTITY_SLOT(h)    ((h)&ENTITY_SLOT_MASK)
+
+// Entities of one kind, stored as parallel component arrays (index i is the
+// same entity in every array). Despawn moves the last entity into the hole,
+// so arrays stay packed; use handles to refer to an entity across frames.
+class entity_store
+{
+  private:
+    int components;
+    std::vector<int> slot_index;    // slot -> dense index, -1 if free
+    std::vector<int> slot_gen;      // slot -> generation, bumped on despawn
+    std::vector<int> free_slots;
+    std::vector<int> handle_list;   // dense index -> handle
+    void resize(int count);
+  public:
+    std::vector<int> x;
+    std::vector<int> y;
+    std::vector<int> dir_x;
+    std::vector<int> dir_y;
+    std::vector<fixed> frame;
+    std::vector<fixed> vel;
+    std::vector<int> state;
+
+    entity_store(int comp);
+    ~entity_store();
+    void reserve(int count);
+    int spawn();
+    int spawn_range(int count);
+    void despawn(int handle);
+    void despawn(const std::vector<int>& handles);
+    void despawn_index(int index);
+    void clear();
+    int size();
+    int handle(int index);
+    int index(int handle);
+    int alive(int handle);
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef EXP_RULES_H
+#define EXP_RULES_H
+
+#include <vector>
+
+///////////////////////////////////
+/*  Rule inputs                  */
+///////////////////////////////////
+// What the game tells the rules, by the names the rules file uses.
+#define EXP_COUNTER_SCORE   0     // "score": treasures brought up this game
+#define EXP_COUNTERS        1
+#define EXP_EVENT_CAUGHT    0     // "caught": value is the score
+#define EXP_EVENTS          1
+#define EXP_STATE_SURFACE   0     // "surface", "water", "floor": where the
+#define EXP_STATE_WATER     1     // ship is, as DEPTH_* in game_state.h
+#define EXP_STATE_FLOOR     2
+#define EXP_STATES          3
+#define EXP_FLAG_LOADED     0     // "loaded": carrying a treasure
+#define EXP_FLAGS           1
+
+typedef void (*exp_func)(int exp);
+
+struct exp_rule
+{
+  int exp;
+  int input;        // counter, event or state
+  int value;        // threshold, event value (-1 any) or frames in the state
+  int flag;         // that must be set or clear when it is met, -1 for none
+  int flag_on;
+};
+
+// Exps won by rules read from a file, one per line:
+//   count <exp> <counter> <at least>
+//   event <exp> <event> [<value>]
+//   time <exp> <state> <frames> [<flag>|!<flag>]
+// A time rule is met on the frame the ship has been that long in the
+// state, if the flag agrees then. Rules wait in lists by the input they
+// watch, so only a change to that input looks at them, and a rule met
+// leaves its list for good; with none left waiting on a state, a frame
+// costs one test.
+class exp_rules
+{
+  private:
+    std::vector<exp_rule> counters[EXP_COUNTERS];   // by threshold
+    std::vector<exp_rule> events[EXP_EVENTS];
+    std::vector<exp_rule> times[EXP_STATES];        // by frames
+    int flags[EXP_FLAGS];
+    int state;
+    int frames;       // in state
+    int deadline;     // frames of the next time rule of state, 0 for none
+    void win(std::vector<exp_rule>& list, int rule);
+    void next_deadline();
+    void reach();
+  public:
+    exp_func award;           // called with each exp won
+
+    exp_rules();
+    ~exp_rules();
+    int read(const char* text, long size);
+    void start(int in_state);
+    void count(int counter, int value);
+    void happen(int event, int value);
+    void enter(int in_state);
+    void flag(int id, int on);
+    void tick()
+    {
+      if(deadline && ++frames==deadline)
+        reach();
+    }
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+///////////////////////////////////
+/*  16.16 fixed point            */
+///////////////////////////////////
+#define FIXED_SHIFT   16
+#define FIXED_ONE     (1<<FIXED_SHIFT)
+// raw value of a literal, rounded to nearest; folded by the compiler
+#define FIXED_RAW(v)  ((int)((v)*FIXED_ONE+((v)<0 ? -0.5 : 0.5)))
+#define FX(v)         fixed::from_raw(FIXED_RAW(v))
+
+// Integer arithmetic only, so the simulation steps the same on x86 and on
+// FPU-less ARM. There is no conversion from float: write constants as FX().
+class fixed
+{
+  private:
+    int raw;
+    fixed(double v);    // not defined: catches float literals at compile time
+  public:
+    fixed() { raw=0; }
+    fixed(int v) { raw=v*FIXED_ONE; }
+    static fixed from_raw(int r) { fixed f; f.raw=r; return f; }
+    int get_raw() const { return raw; }
+    // truncates toward zero, like the (int) cast of a float
+    int to_int() const { return raw>=0 ? raw>>FIXED_SHIFT : -((-raw)>>FIXED_SHIFT); }
+
+    fixed operator-() const { return from_raw(-raw); }
+    fixed operator+(const fixed& o) const { return from_raw(raw+o.raw); }
+    fixed operator-(const fixed& o) const { return from_raw(raw-o.raw); }
+    fixed operator*(const fixed& o) const { return from_raw((int)(((long long)raw*o.raw)>>FIXED_SHIFT)); }
+    fixed operator/(const fixed& o) const { return from_raw((int)(((long long)raw<<FIXED_SHIFT)/o.raw)); }
+    fixed operator*(int v) const { return from_raw(raw*v); }
+    fixed operator/(int v) const { return from_raw(raw/v); }
+    fixed& operator+=(const fixed& o) { raw+=o.raw; return *this; }
+    fixed& operator-=(const fixed& o) { raw-=o.raw; return *this; }
+
+    bool operator<(const fixed& o) const { return raw<o.raw; }
+    bool operator>(const fixed& o) const { return raw>o.raw; }
+    bool operator<=(const fixed& o) const { return raw<=o.raw; }
+    bool operator>=(const fixed& o) const { return raw>=o.raw; }
+    bool operator==(const fixed& o) const { return raw==o.raw; }
+    bool operator!=(const fixed& o) const { return raw!=o.raw; }
+};
+
+#endif
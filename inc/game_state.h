@@ -0,0 +1,137 @@
+#ifndef GAME_STATE_H
+#define GAME_STATE_H
+
+#include <vector>
+#include "fixed.h"
+#include "entity.h"
+#include "spatial_hash.h"
+#include "collision_mask.h"
+
+///////////////////////////////////
+/*  Ship directions              */
+///////////////////////////////////
+#define DIR_DOWN    0
+#define DIR_LEFT    1
+#define DIR_RIGHT   2
+
+///////////////////////////////////
+/*  Game events                  */
+///////////////////////////////////
+#define EVENT_BUBBLE      0   // a bubble to be heard
+#define EVENT_HIT         1   // treasure picked up
+#define EVENT_GOLD        2   // treasure brought to the boat; value: score
+#define EVENT_ROAR        3   // ship caught by a bug; value: score
+#define EVENT_ENGINE_ON   4
+#define EVENT_ENGINE_OFF  5
+#define EVENT_DEPTH       6   // value: the new depth
+
+///////////////////////////////////
+/*  Ship depths                  */
+///////////////////////////////////
+#define DEPTH_SURFACE   0
+#define DEPTH_WATER     1         // between the surface and the floor
+#define DEPTH_FLOOR     2
+
+#define AUTOPILOT_AHEAD 40        // frames the autopilot looks ahead for bugs
+#define PLAN_CRUISE     0         // autopilot plans: keys to reach the target
+#define PLAN_UP         1
+#define PLAN_DOWN       2
+#define PLAN_LEFT       1
+#define PLAN_RIGHT      2
+#define PLAN_COAST      3         // no left or right key
+
+#define SAVE_SECTIONS   19        // arrays in a saved state
+
+struct bubble_base
+{
+  int x;
+  int y;
+  fixed ah;
+  fixed av;
+};
+
+struct game_event
+{
+  int type;
+  int value;
+};
+
+// One game: the ship, the treasures, the bugs and the scenery, stepped a
+// frame at a time. It has no SDL in it: sounds and what exps are won on come
+// out as events, time is counted in frames and random numbers come from its
+// own seed, so any number of games can run side by side on any thread.
+class game_state
+{
+  private:
+    unsigned int rng;
+    std::vector<int> bug_query;           // scratch for hash queries
+    std::vector<int> autopilot_bug_x;     // bugs near the ship, frame by frame
+    std::vector<int> autopilot_bug_y;
+    int autopilot_bugs;
+    int autopilot_target();
+    void autopilot_keys(int x, fixed ah, fixed av, int target_x, int vplan, int hplan, int& up, int& left, int& right);
+    void autopilot_track_bugs();
+    int autopilot_clear(int target_x, int vplan, int hplan);
+    void event(int type, int value);
+  public:
+    // set before reset()
+    int treasure_count;       // treasures per level
+    int cloud_count;
+    int plant_count;          // -1: a row of plants along the floor
+    int collisions;           // 0: bugs are tested against the ship but go through it
+    collision_mask* ship_mask;
+    collision_mask* bug_mask;
+    collision_mask* gold_mask;
+
+    int level;
+    int score;
+    int ship_disabled;
+    int ship_x;
+    int ship_y;
+    fixed ship_ah;
+    fixed ship_av;
+    int ship_load;
+    int engine_on;
+    int caught;               // a bug got the ship this frame
+    int depth;
+    fixed water_wave;
+    entity_store gold_list;   // state: carried
+    entity_store bug_list;
+    entity_store green_list;
+    entity_store cloud_list;
+    spatial_hash bug_hash;    // bugs over the sea area
+    std::vector<bubble_base> bubble_list;
+    std::vector<game_event> events;   // since the host last cleared them
+
+    game_state();
+    ~game_state();
+    void seed(unsigned int s);
+    int random();
+    void reset();
+    void new_level();
+    void new_bug();
+    void new_bubble(int x, int y, int dir);
+    int ship_hit(int x, int y);
+
+    // update() is move_ship(), the passes in any order, then end_update();
+    // a host may run the passes as jobs, bugs before the hash
+    void update();
+    void move_ship();
+    void move_bugs(int begin, int end);
+    void move_bug_hash();
+    void move_bubbles();
+    void move_plants(int begin, int end);
+    void move_clouds(int begin, int end);
+    void end_update();
+
+    void control(int thrust, int left, int right);
+    void autopilot(int avoid_bugs, int& thrust, int& left, int& right);
+
+    // the whole state as ints: the section count, the size of each
+    // section, then the sections; each component array is a section of
+    // its own, so a value keeps its place while other arrays change size
+    void save(std::vector<int>& out);
+    int load(const std::vector<int>& in);
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <deque>
+#include <vector>
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+
+#define JOB_MAX           1024  // jobs between two clear() calls; past it the
+                                // work runs at creation, before its dependencies
+#define JOB_MAX_THREADS   16
+#define JOB_MAX_PARTS     64    // parts of one parallel_for
+
+typedef void (*job_func)(void* data, int begin, int end);
+
+struct job
+{
+  job_func func;
+  void* data;
+  int begin;
+  int end;
+  int pending;                // unfinished dependencies, +1 until submitted
+  int unfinished;             // parts still running
+  int parent;                 // parallel_for this job is a part of
+  int first_part;
+  int parts;
+  std::vector<int> next;      // jobs waiting for this one
+  int done;
+};
+
+struct job_worker
+{
+  class job_system* system;
+  int index;
+};
+
+// Work stealing job pool. Worker 0 is the thread that creates jobs, it runs
+// jobs while it waits. Every worker pops from the back of its own deque and
+// steals from the front of the others.
+class job_system
+{
+  private:
+    job job_list[JOB_MAX];
+    int job_count;
+    int worker_count;
+    int running;
+    int queued;
+    std::deque<int> queue[JOB_MAX_THREADS];
+    SDL_mutex* queue_lock[JOB_MAX_THREADS];
+    SDL_Thread* thread[JOB_MAX_THREADS];
+    job_worker worker[JOB_MAX_THREADS];
+    SDL_mutex* lock;          // counters and sleeping
+    SDL_cond* wake;           // new work queued or a job done
+    int alloc(job_func func, void* data, int begin, int end);
+    void push(int w, int id);
+    int pop(int w);
+    void run(int w, int id);
+    void complete(int w, int id);
+    static int worker_main(void* data);
+  public:
+    job_system();
+    ~job_system();
+    void start(int threads);
+    void stop();
+    int threads();
+    int create(job_func func, void* data, int begin, int end);
+    int parallel_for(job_func func, void* data, int count, int grain);
+    void depend(int id, int on);
+    void submit(int id);
+    void wait(int id);
+    void clear();
+};
+
+int cpu_count();
+
+#endif
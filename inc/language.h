@@ -1,32 +1,76 @@
 #ifndef LANGUAGE_H
 #define LANGUAGE_H
 
+#include "string_ids.h"
+
+class asset_pack;
+
+///////////////////////////////////
+/*  Compiled language layout     */
+///////////////////////////////////
+// All fields are 32-bit little endian. The header, then an entry per string
+// id, then the strings, each 0 ended. An offset of 0 is a string not there.
+#define LANGC_MAGIC     "BLNG"
+#define LANGC_VERSION   1
+#define LANGC_HEADER    28        // magic, version, hash, rule, count, lang, author
+#define LANGC_ENTRY     8         // offset, 1 if safe as a format for one int
+
+// where a string's text lies in its file
+struct lang_entry
+{
+  int id;
+  int start;
+  int length;
+};
+
 struct lang_file
 {
   std::string lang;
   std::string file;
   std::string author;
+  unsigned int hash;              // of the .lang
+  const char* data;               // the .lang in the pack, or NULL for text
+  long size;
+  std::string text;               // the .lang, when read from disk
+  std::vector<lang_entry> entries;
+  const unsigned char* mapped;    // the .langc in the pack, or NULL for compiled
+  long mapped_size;
+  std::vector<unsigned char> compiled;  // the .langc, read or made here
 };
 
+// The languages in lang/. Each name.lang is compiled to name.langc, its
+// strings in one block behind a table by id, stored with the hash of the
+// .lang it came from. A .langc found and current is used as it is, out of
+// the pack or read whole; otherwise the .lang is scanned once and compiled
+// the first time the language is set, and the .langc written for the next
+// run. Setting a language once compiled only switches a pointer. Strings
+// are asked for by string_id; one a language lacks, or every one with no
+// language at all, is the English compiled in.
 class language
 {
   private:
     char nullstring;
     int id_language;
     std::vector<lang_file> language_list;
-    std::vector<std::string> string_list;
-    std::string read_name(std::string file_name);
-    std::string read_author(std::string file_name);
+    const unsigned char* strings;   // the .langc of id_language
+    asset_pack* files;
+    int read_file(lang_file& file);
+    void parse(lang_file& file);
+    int read_compiled(lang_file& file);
+    void compile(lang_file& file);
+    const unsigned char* table(lang_file& file);
   public:
     language();
     ~language();
-    void read_languages();
+    void read_languages(asset_pack& pack);
+    void write_compiled();
     int languages_count();
     void set_language(int id);
     int language_id();
     char* language_name(int id);
     char* language_author(int id);
-    char* get_string(int id);
+    char* get_string(string_id id);
+    char* get_format(string_id id);
 };
 
 #endif
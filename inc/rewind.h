@@ -0,0 +1,44 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <vector>
+
+// The last frames of a game, newest last, in a fixed number of bytes. Every
+// keyframe_every frames a whole state is stored, the frames between store
+// only what changed since the frame before; when the bytes or the frame
+// slots run out the oldest keyframe goes, with the frames that need it.
+//
+// A state is a std::vector<int> laid out as game_state::save() writes it:
+// the section count, the section sizes, then the sections.
+class rewind_buffer
+{
+  private:
+    std::vector<unsigned char> data;    // records, written round
+    std::vector<int> record_start;      // ring of frames, oldest at first
+    std::vector<int> record_size;
+    std::vector<char> record_key;
+    int first;
+    int count;
+    int head;                           // where the next record goes
+    int key_interval;
+    int since_key;                      // frames stored after the last keyframe
+    std::vector<int> last;              // newest state, base of the next delta
+    std::vector<int> scratch;
+    std::vector<unsigned char> packed;
+    void encode(const std::vector<int>& state, const std::vector<int>& base);
+    void decode(int record, const std::vector<int>& base, std::vector<int>& out);
+    int make_room(int size);
+    void drop_oldest();
+  public:
+    rewind_buffer(int bytes, int frames, int keyframe_every);
+    ~rewind_buffer();
+    void clear();
+    void capture(const std::vector<int>& state);
+    int frames();
+    int seek(int back, std::vector<int>& state);
+    void drop(int n);
+    const std::vector<int>& newest();
+    int used();
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SOUND_DECODER_H
+#define SOUND_DECODER_H
+
+#include <cstdio>
+#include <vector>
+#ifdef USE_TREMOR
+#include <tremor/ivorbisfile.h>
+#endif
+
+#define DECODER_NONE    0
+#define DECODER_PCM     1         // WAV, 8 or 16 bits
+#define DECODER_ADPCM   2         // WAV, IMA ADPCM, 4 bits
+#define DECODER_OGG     3         // Ogg Vorbis, only built with USE_TREMOR
+
+// Reads a sound file of any of the kinds above, telling them apart by
+// their first bytes, as 16-bit stereo frames at the file's own rate. Only
+// the first two channels of a file with more are kept.
+class sound_decoder
+{
+  private:
+    int type;
+    FILE* file;                   // or the file in memory
+    const unsigned char* mem;
+    long mem_size;
+    long mem_pos;
+    int channels;
+    int file_rate;
+    int bytes;                    // PCM: per sample
+    long data_start;
+    long data_size;
+    long data_pos;                // from data_start
+    int block_align;              // ADPCM: bytes and frames of a block
+    int block_frames;
+    std::vector<unsigned char> raw;
+    std::vector<int> block;       // ADPCM block or Ogg packet, decoded
+    int block_count;
+    int block_pos;
+#ifdef USE_TREMOR
+    OggVorbis_File ogg;
+#endif
+    int open_source();
+    int read_bytes(void* dst, long size);
+    int seek_to(long pos);
+    long tell();
+    int open_wav();
+    int open_ogg();
+    int read_pcm(int* dst, int frames);
+    int decode_block();
+    int decode_ogg();
+#ifdef USE_TREMOR
+    static size_t ogg_read(void* dst, size_t size, size_t count, void* source);
+    static int ogg_seek(void* source, ogg_int64_t offset, int whence);
+    static int ogg_close(void* source);
+    static long ogg_tell(void* source);
+#endif
+  public:
+    sound_decoder();
+    ~sound_decoder();
+    int open(const char* name);
+    int open(const void* data, long size);
+    void close();
+    int kind();
+    int rate();
+    int read(int* dst, int frames);
+    int restart();
+};
+
+#endif
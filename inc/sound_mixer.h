@@ -0,0 +1,93 @@
+#ifndef SOUND_MIXER_H
+#define SOUND_MIXER_H
+
+#include <vector>
+
+#define MIXER_VOICES    8         // sounds heard at once
+#define MIXER_SOUNDS    8         // sound ids
+#define MIXER_BLOCK     256       // frames mixed at a time
+#define MIXER_COMMANDS  64        // queued between two callbacks, a power of 2
+
+#define MIXER_PLAY      0
+#define MIXER_STOP      1
+#define MIXER_VOLUME    2
+#define MIXER_LOOPS     3
+
+// Short sounds mixed from memory into the audio callback's buffer through a
+// fixed pool of voices. When every voice is taken, a sound takes the one
+// of the lowest priority, the oldest of them, if that is not above its own;
+// else it is dropped. A sound played again sooner than its interval after
+// the last time is not started again, the voice already playing it stands
+// for both.
+//
+// play(), stop(), volume() and loops() queue a command and return at once,
+// never waiting on the audio thread: one thread may call them, mix() on the
+// audio thread carries them out before it mixes. A command that finds the
+// queue full is lost. set() is for sounds not playing. stop_all() may come
+// from another thread: the next mix() stops every voice and drops what was
+// queued before it.
+class sound_mixer
+{
+  private:
+    struct voice
+    {
+      int sound;                  // -1 if free
+      int pos;                    // next sample
+      int volume;                 // 0-128
+      int loops;                  // times still to go back to the start, -1 always
+      int priority;
+      unsigned int start;         // clock when it started
+    };
+    struct sound
+    {
+      std::vector<short> pcm;     // in the output format
+      int priority;
+      unsigned int interval;      // frames
+      unsigned int last;          // clock when it last started
+      int played;                 // ever, else last means nothing
+    };
+    struct command
+    {
+      int type;                   // MIXER_*
+      int sound;
+      int value;
+      int loops;
+    };
+    command commands[MIXER_COMMANDS];
+    volatile int command_write;   // free running
+    volatile int command_read;
+    volatile int stops_asked;     // stop_all() calls
+    int stops_done;               // seen by mix()
+    int channels;
+    sound sounds[MIXER_SOUNDS];
+    voice pool[MIXER_VOICES];
+    int acc[MIXER_BLOCK*2];
+    volatile unsigned int clock;  // frames mixed
+    volatile int active;          // voices playing after the last mix()
+    int find_voice(int priority);
+    void queue(int type, int id, int value, int loops);
+    void run_commands();
+    void start(int id, int volume, int loops);
+  public:
+    int plays;
+    int coalesced;                // plays the voice already playing stood for
+    int stolen;                   // voices taken from a sound still playing
+    int dropped;                  // plays with no voice for them
+    int lost;                     // commands that found the queue full
+    int voices_peak;
+
+    sound_mixer();
+    ~sound_mixer();
+    void open(int out_ch);
+    void set(int id, std::vector<short>& pcm, int priority, int interval);
+    int loaded(int id);
+    void play(int id, int volume, int loops);
+    void stop(int id);
+    void volume(int id, int volume);
+    void loops(int id, int loops);
+    void stop_all();
+    void mix(short* out, int frames);
+    int voices();
+};
+
+#endif
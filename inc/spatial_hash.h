@@ -0,0 +1,41 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <vector>
+
+// Uniform grid over a rectangle of the play field. Each entry is an entity
+// handle with a point position; entries outside the rectangle are kept in the
+// border cells. Moving an entry only relinks it when it changes cell.
+class spatial_hash
+{
+  private:
+    int origin_x;
+    int origin_y;
+    int cell_size;
+    int cols;
+    int rows;
+    std::vector<int> cell_head;     // cell -> first entry, -1 if empty
+    std::vector<int> entry_next;    // entry -> next entry in cell
+    std::vector<int> entry_prev;    // entry -> previous entry in cell
+    std::vector<int> entry_cell;    // entry -> cell, -1 if not inserted
+    std::vector<int> entry_handle;
+    std::vector<int> entry_x;
+    std::vector<int> entry_y;
+    int count;
+    int cell_of(int x, int y);
+    void link(int id, int cell);
+    void unlink(int id);
+  public:
+    spatial_hash(int x, int y, int w, int h, int cell);
+    ~spatial_hash();
+    void clear();
+    void insert(int handle, int x, int y);
+    void move(int handle, int x, int y);
+    void remove(int handle);
+    int size();
+    int query_rect(int x0, int y0, int x1, int y1, std::vector<int>& result);
+    int query_overlap(int x, int y, int w, int h, std::vector<int>& result);
+    int query_nearest(int x, int y, int k, std::vector<int>& result);
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef SPRITE_CACHE_H
+#define SPRITE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <SDL/SDL.h>
+#include "collision_mask.h"
+
+///////////////////////////////////
+/*  Cache file layout            */
+///////////////////////////////////
+// All fields are 32-bit little endian. The header, then an entry per
+// sprite, then the pixels of each, rows without padding, and its collision
+// mask, a 64-bit word per row, each at a multiple of 4.
+#define CACHE_MAGIC     "BSPC"
+#define CACHE_VERSION   1
+#define CACHE_HEADER    32        // magic, version, count, bits, r, g, b masks, colour key
+#define CACHE_ENTRY     64        // name, slice, hash, w, h, pixels, mask
+#define CACHE_NAME      40
+
+unsigned int fnv_hash(const void* data, long size);
+
+// Sprites as they are drawn: in the screen's pixel format, cut out of their
+// strips, with the colour key and the collision mask ready. Each is stored
+// with the hash of the file it came from, so a changed file is cooked again
+// rather than taken from the cache. Whatever was asked for, cooked or
+// taken, goes into the next cache written.
+class sprite_cache
+{
+  private:
+    std::vector<unsigned char> file;    // the cache when read from disk
+    const unsigned char* data;
+    long size;
+    int count;
+    struct cooked
+    {
+      std::string name;
+      int slice;
+      unsigned int hash;
+      int w;
+      int h;
+      std::vector<unsigned char> pixels;
+      std::vector<mask_row> mask;
+    };
+    std::vector<cooked> out;
+    const unsigned char* find(const char* name, int slice, unsigned int hash);
+  public:
+    int misses;                         // sprites not in the cache, or stale
+
+    sprite_cache();
+    ~sprite_cache();
+    int open(const void* bytes, long bytes_size, SDL_PixelFormat* format);
+    int open(const char* path, SDL_PixelFormat* format);
+    SDL_Surface* get(const char* name, int slice, unsigned int hash, collision_mask* mask);
+    void add(const char* name, int slice, unsigned int hash, SDL_Surface* sprite, collision_mask* mask);
+    int write(const char* path, SDL_PixelFormat* format);
+    void close();
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef STATS_H
+#define STATS_H
+
+///////////////////////////////////
+/*  Frame timers                 */
+///////////////////////////////////
+#define STAT_FRAME    0   // whole frame, without the FPS delay
+#define STAT_UPDATE   1   // simulation
+#define STAT_DRAW     2   // game layers into screen
+#define STAT_EXP      3   // exp notices over screen
+#define STAT_FILTER   4   // x2 zoom into screen2
+#define STAT_FLIP     5   // SDL_Flip()
+#define STAT_WAIT     6   // for a buffer the presenter still shows
+#define STAT_COUNT    7
+
+long long stats_usec();
+
+// Per frame timings in microseconds. A timer may be started and stopped
+// several times in a frame; next_frame() closes the frame.
+class frame_stats
+{
+  private:
+    long long start[STAT_COUNT];
+    long long current[STAT_COUNT];
+    long long total[STAT_COUNT];
+    long long peak[STAT_COUNT];
+    int frames;
+  public:
+    frame_stats();
+    ~frame_stats();
+    void reset();
+    void begin(int id);
+    void end(int id);
+    void next_frame();
+    int count();
+    int average(int id);
+    int maximum(int id);
+    const char* name(int id);
+};
+
+#endif
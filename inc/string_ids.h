@@ -0,0 +1,23 @@
+// Made by tools/string_ids from lang/English.lang, do not edit.
+#ifndef STRING_IDS_H
+#define STRING_IDS_H
+
+#define FALLBACK_LANGUAGE "English"
+
+enum string_id
+{
+  STRING_RAFA_VICO_PRESENTS=1,
+  STRING_PLAY=2,
+  STRING_EXIT=3,
+  STRING_LEVEL=4,
+  STRING_SCORE=5,
+  STRING_BATHYSCAPHE=6,
+  STRING_END=7,
+  STRING_COUNT=8
+};
+
+// the strings of lang/English.lang by id, and 1 for those safe as a format for one int
+extern const char* const fallback_strings[];
+extern const char fallback_formats[];
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include "atomic.h"
+
+#define TRIPLE_INDEX    3
+#define TRIPLE_FRESH    4
+
+// One writer thread and one reader thread exchanging whole values without
+// locks. The writer fills write_buffer() and publishes it; the reader takes
+// the newest published value with update(). Neither ever waits: the writer
+// overwrites values the reader skipped, the reader keeps its value until a
+// newer one is published.
+template <class T>
+class triple_buffer
+{
+  private:
+    T slot[3];
+    volatile int middle;    // last published slot, TRIPLE_FRESH if unread
+    int back;               // writer's slot
+    int front;              // reader's slot
+  public:
+    triple_buffer()
+    {
+      back=0;
+      middle=1;
+      front=2;
+    }
+
+    T& write_buffer()
+    {
+      return slot[back];
+    }
+
+    void publish()
+    {
+      back=atomic_exchange(&middle,back|TRIPLE_FRESH)&TRIPLE_INDEX;
+    }
+
+    // move to the newest published value; 0 if there is nothing new
+    int update()
+    {
+      if(!(atomic_get(&middle)&TRIPLE_FRESH))
+        return 0;
+      front=atomic_exchange(&middle,front)&TRIPLE_INDEX;
+      return 1;
+    }
+
+    T& read_buffer()
+    {
+      return slot[front];
+    }
+};
+
+#endif
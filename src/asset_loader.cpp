@@ -0,0 +1,87 @@
+#include <vector>
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+#include "../inc/atomic.h"
+#include "../inc/stats.h"
+#include "../inc/asset_loader.h"
+
+asset_loader::asset_loader()
+{
+  thread=NULL;
+  start_usec=0;
+}
+
+asset_loader::~asset_loader()
+{
+}
+
+// before start() only; returns the id ready() takes
+int asset_loader::add(asset_func func, void* data)
+{
+  func_list.push_back(func);
+  data_list.push_back(data);
+  ready_list.push_back(0);
+  done_usec.push_back(0);
+  return func_list.size()-1;
+}
+
+void asset_loader::load_all()
+{
+  for(int f=0; f<func_list.size(); f++)
+  {
+    func_list[f](data_list[f]);
+    done_usec[f]=stats_usec()-start_usec;
+    atomic_set(&ready_list[f],1);
+  }
+}
+
+int asset_loader::loader_main(void* data)
+{
+  ((asset_loader*)data)->load_all();
+  return 0;
+}
+
+// threaded 0: everything is loaded before start() returns
+void asset_loader::start(int threaded)
+{
+  start_usec=stats_usec();
+  if(threaded)
+    thread=SDL_CreateThread(loader_main,this);
+  if(!thread)
+    load_all();
+}
+
+void asset_loader::wait()
+{
+  if(thread)
+  {
+    SDL_WaitThread(thread,NULL);
+    thread=NULL;
+  }
+}
+
+int asset_loader::ready(int id)
+{
+  return id>=0 && id<ready_list.size() && atomic_get(&ready_list[id]);
+}
+
+int asset_loader::count()
+{
+  return func_list.size();
+}
+
+int asset_loader::loaded()
+{
+  int n=0;
+  for(int f=0; f<ready_list.size(); f++)
+    n+=atomic_get(&ready_list[f]);
+  return n;
+}
+
+// microseconds from start() until the asset was ready, 0 if it is not
+int asset_loader::usec(int id)
+{
+  if(!ready(id))
+    return 0;
+  return (int)done_usec[id];
+}
@@ -0,0 +1,213 @@
+#ifdef PLATFORM_WIN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <SDL/SDL.h>
+#include "../inc/asset_pack.h"
+
+static long read_u32(const unsigned char* p)
+{
+  return (long)p[0]|((long)p[1]<<8)|((long)p[2]<<16)|((long)p[3]<<24);
+}
+
+asset_pack::asset_pack()
+{
+  base=NULL;
+  size=0;
+  mapped=0;
+  loose=0;
+#ifdef PLATFORM_WIN
+  file_handle=NULL;
+  map_handle=NULL;
+#endif
+}
+
+asset_pack::~asset_pack()
+{
+  close();
+}
+
+// map the pack at path; 0 if it is missing or not a pack, and then every
+// file is read from disk
+int asset_pack::open(const char* path)
+{
+  close();
+#ifdef PLATFORM_WIN
+  HANDLE file=CreateFileA(path,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+  if(file==INVALID_HANDLE_VALUE)
+    return 0;
+  file_handle=file;
+  size=GetFileSize(file,NULL);
+  map_handle=CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+  if(map_handle)
+    base=(const unsigned char*)MapViewOfFile(map_handle,FILE_MAP_READ,0,0,0);
+#else
+  int file=::open(path,O_RDONLY);
+  if(file<0)
+    return 0;
+  struct stat info;
+  if(fstat(file,&info)==0 && info.st_size>0)
+  {
+    size=info.st_size;
+    void* view=mmap(NULL,size,PROT_READ,MAP_PRIVATE,file,0);
+    if(view!=MAP_FAILED)
+      base=(const unsigned char*)view;
+  }
+  ::close(file);        // the mapping stays
+#endif
+  mapped=1;
+  return read_index();
+}
+
+// a pack already in memory, like one built into the program
+int asset_pack::open(const void* data, long bytes)
+{
+  close();
+  base=(const unsigned char*)data;
+  size=bytes;
+  return read_index();
+}
+
+int asset_pack::read_index()
+{
+  if(!base || size<PACK_HEADER || memcmp(base,PACK_MAGIC,4) || read_u32(base+4)!=PACK_VERSION)
+  {
+    close();
+    return 0;
+  }
+
+  long count=read_u32(base+8);
+  if(count<0 || count>(size-PACK_HEADER)/PACK_ENTRY)
+  {
+    close();
+    return 0;
+  }
+  for(long f=0; f<count; f++)
+  {
+    const unsigned char* entry=base+PACK_HEADER+f*PACK_ENTRY;
+    long offset=read_u32(entry);
+    long bytes=read_u32(entry+4);
+    if(offset<0 || bytes<0 || offset>size || bytes>size-offset || entry[8+PACK_NAME-1]!=0)
+      continue;
+    names.push_back((const char*)entry+8);
+    datas.push_back(base+offset);
+    sizes.push_back(bytes);
+  }
+  return 1;
+}
+
+void asset_pack::close()
+{
+#ifdef PLATFORM_WIN
+  if(base && mapped)
+    UnmapViewOfFile((void*)base);
+  if(map_handle)
+    CloseHandle(map_handle);
+  if(file_handle)
+    CloseHandle(file_handle);
+  map_handle=NULL;
+  file_handle=NULL;
+#else
+  if(base && mapped)
+    munmap((void*)base,size);
+#endif
+  mapped=0;
+  base=NULL;
+  size=0;
+  names.clear();
+  datas.clear();
+  sizes.clear();
+}
+
+// files in the pack
+int asset_pack::entries()
+{
+  return names.size();
+}
+
+int asset_pack::find(const char* name)
+{
+  for(int f=0; f<names.size(); f++)
+    if(!strcmp(names[f],name))
+      return f;
+  return -1;
+}
+
+int asset_pack::on_disk(const char* name)
+{
+  FILE* file=fopen(name,"rb");
+  if(!file)
+    return 0;
+  fclose(file);
+  return 1;
+}
+
+// the bytes of a file in the pack, valid while the pack is open; NULL if
+// it is to be read from disk
+const void* asset_pack::map(const char* name, long& bytes)
+{
+  int f=find(name);
+  if(f<0 || (loose && on_disk(name)))
+    return NULL;
+  bytes=sizes[f];
+  return datas[f];
+}
+
+int asset_pack::exists(const char* name)
+{
+  return find(name)>=0 || on_disk(name);
+}
+
+// a read only SDL_RWops over the file, for the SDL loaders; NULL if it is
+// nowhere
+SDL_RWops* asset_pack::rw(const char* name)
+{
+  long bytes;
+  const void* data=map(name,bytes);
+  if(data)
+    return SDL_RWFromConstMem(data,bytes);
+  return SDL_RWFromFile(name,"rb");
+}
+
+// names, without dir, of the files in dir ending in ext; those on disk too
+// with loose set or with no pack
+void asset_pack::list(const char* dir, const char* ext, std::vector<std::string>& out)
+{
+  out.clear();
+  int dir_len=strlen(dir);
+  int ext_len=strlen(ext);
+  for(int f=0; f<names.size(); f++)
+  {
+    int len=strlen(names[f]);
+    if(len>dir_len+ext_len && names[f][dir_len]=='/' && !strncmp(names[f],dir,dir_len) && !strcmp(names[f]+len-ext_len,ext))
+      out.push_back(names[f]+dir_len+1);
+  }
+
+  if(base && !loose)
+    return;
+  DIR* dp=opendir(dir);
+  if(!dp)
+    return;
+  struct dirent* dirp;
+  while((dirp=readdir(dp))!=NULL)
+  {
+    std::string file=dirp->d_name;
+    if(file.size()<=ext_len || file.substr(file.size()-ext_len)!=ext)
+      continue;
+    int f=0;
+    while(f<out.size() && out[f]!=file)
+      f++;
+    if(f==out.size())
+      out.push_back(file);
+  }
+  closedir(dp);
+}
@@ -0,0 +1,209 @@
+#include <cstdio>
+#include <vector>
+#include "../inc/atomic.h"
+#include "../inc/audio_stream.h"
+
+audio_stream::audio_stream()
+{
+  loop=0;
+  write_pos=0;
+  read_pos=0;
+  playing=0;
+  starved=0;
+}
+
+audio_stream::~audio_stream()
+{
+  close();
+}
+
+// anything sound_decoder reads, played at rate with out_ch channels of
+// 16-bit samples; 0 if the file does not decode
+int audio_stream::open(const char* name, int rate, int out_ch, int looping)
+{
+  close();
+  if(rate<=0 || (out_ch!=1 && out_ch!=2) || !decoder.open(name))
+    return 0;
+  return start(rate,out_ch,looping);
+}
+
+// the same from a file in memory, which must stay there until close()
+int audio_stream::open(const void* data, long size, int rate, int out_ch, int looping)
+{
+  close();
+  if(rate<=0 || (out_ch!=1 && out_ch!=2) || !decoder.open(data,size))
+    return 0;
+  return start(rate,out_ch,looping);
+}
+
+int audio_stream::start(int rate, int out_ch, int looping)
+{
+  loop=looping;
+  out_channels=out_ch;
+  step=(unsigned int)(((long long)decoder.rate()<<16)/rate);
+  phase=0;
+  src.resize((STREAM_READ+1)*2);
+  src_count=0;
+  src_pos=0;
+  if(loop)
+    ring.resize(STREAM_FRAMES*out_channels);
+  write_pos=0;
+  read_pos=0;
+  return 1;
+}
+
+void audio_stream::close()
+{
+  playing=0;
+  decoder.close();
+}
+
+int audio_stream::kind()
+{
+  return decoder.kind();
+}
+
+// next frames from the decoder after the ones still needed; 0 at the end
+// of a stream that does not loop, or on a read error
+int audio_stream::read_source()
+{
+  int keep=src_count-src_pos;
+  if(keep>0)
+  {
+    src[0]=src[src_pos*2];
+    src[1]=src[src_pos*2+1];
+    src_count=1;
+    src_pos=0;
+  }
+  else
+  {
+    src_count=0;
+    src_pos=-keep;      // frames stepped over past the block
+  }
+
+  int n=decoder.read(&src[src_count*2],STREAM_READ);
+  if(n==0 && loop && decoder.restart())
+    n=decoder.read(&src[src_count*2],STREAM_READ);
+  src_count+=n;
+  return n>0;
+}
+
+// up to frames output frames, interpolated between source frames
+int audio_stream::convert(short* out, int frames)
+{
+  for(int f=0; f<frames; f++)
+  {
+    while(src_pos+1>=src_count)
+      if(!read_source())
+        return f;
+    const int* a=&src[src_pos*2];
+    int ph=phase>>1;
+    int l=a[0]+(((a[2]-a[0])*ph)>>15);
+    int r=a[1]+(((a[3]-a[1])*ph)>>15);
+    if(out_channels==2)
+    {
+      *out++=l;
+      *out++=r;
+    }
+    else
+      *out++=(l+r)/2;
+    phase+=step;
+    src_pos+=phase>>16;
+    phase&=0xffff;
+  }
+  return frames;
+}
+
+// top up the ring of a looping stream; any thread but the audio one, one
+// at a time
+void audio_stream::fill()
+{
+  if(!loop || !decoder.kind())
+    return;
+  int w=write_pos;
+  int space=STREAM_FRAMES-(w-atomic_get(&read_pos));
+  while(space>0)
+  {
+    // up to the end of the ring, then round
+    int at=w&(STREAM_FRAMES-1);
+    int n=STREAM_FRAMES-at;
+    if(n>space)
+      n=space;
+    int done=convert(&ring[at*out_channels],n);
+    w+=done;
+    space-=done;
+    if(done<n)
+      break;
+  }
+  atomic_set(&write_pos,w);
+}
+
+// the whole sound, for a stream opened without looping; 0 if it is empty
+int audio_stream::decode_all(std::vector<short>& out)
+{
+  out.clear();
+  if(loop || !decoder.kind())
+    return 0;
+  int frames=0;
+  for(;;)
+  {
+    out.resize((frames+STREAM_READ)*out_channels);
+    int n=convert(&out[frames*out_channels],STREAM_READ);
+    frames+=n;
+    if(n<STREAM_READ)
+      break;
+  }
+  out.resize(frames*out_channels);
+  return frames>0;
+}
+
+// audio thread: add frames at volume (0-128) into out; a ring that ran
+// dry leaves the rest of out as it was
+void audio_stream::mix(short* out, int frames, int volume)
+{
+  if(!atomic_get(&playing))
+    return;
+  int r=read_pos;
+  int n=atomic_get(&write_pos)-r;
+  if(n<frames)
+    starved++;
+  if(n>frames)
+    n=frames;
+  for(int f=0; f<n; f++)
+  {
+    const short* in=&ring[((r+f)&(STREAM_FRAMES-1))*out_channels];
+    for(int c=0; c<out_channels; c++)
+    {
+      int v=*out+in[c]*volume/128;
+      if(v>32767)
+        v=32767;
+      if(v<-32768)
+        v=-32768;
+      *out++=v;
+    }
+  }
+  atomic_set(&read_pos,r+n);
+}
+
+void audio_stream::play()
+{
+  if(loop)
+    atomic_set(&playing,1);
+}
+
+int audio_stream::is_playing()
+{
+  return atomic_get(&playing);
+}
+
+// mix() calls that ran out of frames, the filling thread being late
+int audio_stream::starved_count()
+{
+  return starved;
+}
+
+// the ring keeps its frames, play() goes on from there
+void audio_stream::stop()
+{
+  atomic_set(&playing,0);
+}
@@ -0,0 +1,81 @@
+#include <vector>
+#include "../inc/collision_mask.h"
+
+collision_mask::collision_mask()
+{
+  width=0;
+  height=0;
+}
+
+collision_mask::~collision_mask()
+{
+}
+
+void collision_mask::create(int w, int h)
+{
+  if(w>MASK_MAX_WIDTH)
+    w=MASK_MAX_WIDTH;
+  width=w;
+  height=h;
+  rows.assign(h,0);
+}
+
+void collision_mask::set(int x, int y)
+{
+  if(x>=0 && x<width && y>=0 && y<height)
+    rows[y]|=mask_row(1)<<x;
+}
+
+// a whole row of bits, as a cache keeps it
+mask_row collision_mask::row(int y)
+{
+  return y>=0 && y<height ? rows[y] : 0;
+}
+
+void collision_mask::set_row(int y, mask_row bits)
+{
+  if(y>=0 && y<height)
+    rows[y]=bits;
+}
+
+int collision_mask::w()
+{
+  return width;
+}
+
+int collision_mask::h()
+{
+  return height;
+}
+
+int collision_mask::empty()
+{
+  return width==0 || height==0;
+}
+
+// this mask placed at x,y against other placed at ox,oy
+int collision_mask::overlap(int x, int y, collision_mask& other, int ox, int oy)
+{
+  if(x+width<=ox || ox+other.width<=x || y+height<=oy || oy+other.height<=y)
+    return 0;
+
+  // boxes intersect, so the shift is always below the 64 bit row width
+  int dx=ox-x;
+  int y0=(y>oy) ? y : oy;
+  int y1=(y+height<oy+other.height) ? y+height : oy+other.height;
+  const mask_row* a=&rows[y0-y];
+  const mask_row* b=&other.rows[y0-oy];
+  if(dx>=0)
+  {
+    for(int f=0; f<y1-y0; f++)
+      if(a[f]&(b[f]<<dx))
+        return 1;
+  }
+  else
+  {
+    for(int f=0; f<y1-y0; f++)
+      if(a[f]&(b[f]>>-dx))
+        return 1;
+  }
+  return 0;
+}
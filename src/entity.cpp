@@ -0,0 +1,179 @@
+#include <vector>
+#include "../inc/entity.h"
+
+#define GEN_MASK    0x7fff
+
+entity_store::entity_store(int comp)
+{
+  components=comp;
+}
+
+entity_store::~entity_store()
+{
+}
+
+void entity_store::resize(int count)
+{
+  if(components&COMP_POS)
+  {
+    x.resize(count);
+    y.resize(count);
+  }
+  if(components&COMP_DIR)
+  {
+    dir_x.resize(count);
+    dir_y.resize(count);
+  }
+  if(components&COMP_FRAME)
+  {
+    frame.resize(count);
+    vel.resize(count);
+  }
+  if(components&COMP_STATE)
+    state.resize(count);
+}
+
+void entity_store::reserve(int count)
+{
+  handle_list.reserve(count);
+  if(components&COMP_POS)
+  {
+    x.reserve(count);
+    y.reserve(count);
+  }
+  if(components&COMP_DIR)
+  {
+    dir_x.reserve(count);
+    dir_y.reserve(count);
+  }
+  if(components&COMP_FRAME)
+  {
+    frame.reserve(count);
+    vel.reserve(count);
+  }
+  if(components&COMP_STATE)
+    state.reserve(count);
+}
+
+// spawn one entity, components are zeroed; returns its handle
+int entity_store::spawn()
+{
+  return handle(spawn_range(1));
+}
+
+// spawn a block of entities; returns the dense index of the first one
+int entity_store::spawn_range(int count)
+{
+  int first=handle_list.size();
+  resize(first+count);
+  for(int f=0; f<count; f++)
+  {
+    int slot;
+    if(free_slots.size()>0)
+    {
+      slot=free_slots.back();
+      free_slots.pop_back();
+    }
+    else
+    {
+      slot=slot_index.size();
+      slot_index.push_back(-1);
+      slot_gen.push_back(0);
+    }
+    slot_index[slot]=first+f;
+    handle_list.push_back((slot_gen[slot]<<ENTITY_SLOT_BITS)|slot);
+  }
+  return first;
+}
+
+void entity_store::despawn(int handle)
+{
+  int i=index(handle);
+  if(i>=0)
+    despawn_index(i);
+}
+
+void entity_store::despawn(const std::vector<int>& handles)
+{
+  for(int f=0; f<handles.size(); f++)
+    despawn(handles[f]);
+}
+
+// remove entity at dense index, the last entity takes its place
+void entity_store::despawn_index(int index)
+{
+  int last=handle_list.size()-1;
+  if(index<0 || index>last)
+    return;
+
+  int slot=handle_list[index]&ENTITY_SLOT_MASK;
+  slot_index[slot]=-1;
+  slot_gen[slot]=(slot_gen[slot]+1)&GEN_MASK;
+  free_slots.push_back(slot);
+
+  if(index!=last)
+  {
+    handle_list[index]=handle_list[last];
+    slot_index[handle_list[index]&ENTITY_SLOT_MASK]=index;
+    if(components&COMP_POS)
+    {
+      x[index]=x[last];
+      y[index]=y[last];
+    }
+    if(components&COMP_DIR)
+    {
+      dir_x[index]=dir_x[last];
+      dir_y[index]=dir_y[last];
+    }
+    if(components&COMP_FRAME)
+    {
+      frame[index]=frame[last];
+      vel[index]=vel[last];
+    }
+    if(components&COMP_STATE)
+      state[index]=state[last];
+  }
+  handle_list.pop_back();
+  resize(last);
+}
+
+void entity_store::clear()
+{
+  for(int f=0; f<handle_list.size(); f++)
+  {
+    int slot=handle_list[f]&ENTITY_SLOT_MASK;
+    slot_index[slot]=-1;
+    slot_gen[slot]=(slot_gen[slot]+1)&GEN_MASK;
+    free_slots.push_back(slot);
+  }
+  handle_list.clear();
+  resize(0);
+}
+
+int entity_store::size()
+{
+  return handle_list.size();
+}
+
+int entity_store::handle(int index)
+{
+  if(index>=0 && index<handle_list.size())
+    return handle_list[index];
+  return ENTITY_NONE;
+}
+
+// dense index of a live handle, -1 if it was despawned
+int entity_store::index(int handle)
+{
+  if(handle<0)
+    return -1;
+  int slot=handle&ENTITY_SLOT_MASK;
+  if(slot>=slot_index.size() || slot_gen[slot]!=(handle>>ENTITY_SLOT_BITS))
+    return -1;
+  return slot_index[slot];
+}
+
+int entity_store::alive(int handle)
+{
+  return index(handle)>=0;
+}
@@ -0,0 +1,160 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../inc/exp_rules.h"
+
+static const char* counter_names[EXP_COUNTERS]={"score"};
+static const char* event_names[EXP_EVENTS]={"caught"};
+static const char* state_names[EXP_STATES]={"surface","water","floor"};
+static const char* flag_names[EXP_FLAGS]={"loaded"};
+
+static int find_name(const char** names, int count, const char* name)
+{
+  for(int f=0; f<count; f++)
+    if(!strcmp(names[f],name))
+      return f;
+  return -1;
+}
+
+// keep list ordered by value, a new rule after those equal to it
+static void insert_rule(std::vector<exp_rule>& list, const exp_rule& r)
+{
+  int f=0;
+  while(f<list.size() && list[f].value<=r.value)
+    f++;
+  list.insert(list.begin()+f,r);
+}
+
+exp_rules::exp_rules()
+{
+  for(int f=0; f<EXP_FLAGS; f++)
+    flags[f]=0;
+  state=-1;
+  frames=0;
+  deadline=0;
+  award=NULL;
+}
+
+exp_rules::~exp_rules()
+{
+}
+
+// the rules in text, added to those read before; the count of lines that
+// are not rules, comments (#) or blank
+int exp_rules::read(const char* text, long size)
+{
+  int bad=0;
+  long pos=0;
+  while(pos<size)
+  {
+    const char* eol=(const char*)memchr(text+pos,'\n',size-pos);
+    long end=eol ? eol-text : size;
+    std::string line(text+pos,end-pos);
+    pos=end+1;
+    if(line.find('#')!=std::string::npos)
+      line.erase(line.find('#'));
+
+    char kind[16];
+    char input[16];
+    char condition[16];
+    exp_rule r;
+    r.value=-1;
+    r.flag=-1;
+    r.flag_on=1;
+    condition[0]=0;
+    int fields=sscanf(line.c_str(),"%15s %i %15s %i %15s",kind,&r.exp,input,&r.value,condition);
+    if(fields<=0)
+      continue;
+    if(fields<3)
+    {
+      bad++;
+      continue;
+    }
+    if(condition[0])
+    {
+      r.flag_on=condition[0]!='!';
+      r.flag=find_name(flag_names,EXP_FLAGS,condition+!r.flag_on);
+    }
+
+    std::string k=kind;
+    if(k=="count" && fields==4 && (r.input=find_name(counter_names,EXP_COUNTERS,input))>=0)
+      insert_rule(counters[r.input],r);
+    else if(k=="event" && fields<=4 && (r.input=find_name(event_names,EXP_EVENTS,input))>=0)
+      events[r.input].push_back(r);
+    else if(k=="time" && fields>=4 && r.value>0 && (fields==4 || r.flag>=0) &&
+            (r.input=find_name(state_names,EXP_STATES,input))>=0)
+      insert_rule(times[r.input],r);
+    else
+      bad++;
+  }
+  next_deadline();
+  return bad;
+}
+
+// a new game, in in_state with every flag clear
+void exp_rules::start(int in_state)
+{
+  for(int f=0; f<EXP_FLAGS; f++)
+    flags[f]=0;
+  enter(in_state);
+}
+
+void exp_rules::win(std::vector<exp_rule>& list, int rule)
+{
+  int exp=list[rule].exp;
+  list.erase(list.begin()+rule);
+  if(award)
+    award(exp);
+}
+
+// the counter has reached value
+void exp_rules::count(int counter, int value)
+{
+  std::vector<exp_rule>& list=counters[counter];
+  while(list.size()>0 && list[0].value<=value)
+    win(list,0);
+}
+
+void exp_rules::happen(int event, int value)
+{
+  std::vector<exp_rule>& list=events[event];
+  for(int f=0; f<list.size(); f++)
+    if(list[f].value<0 || list[f].value==value)
+      win(list,f--);
+}
+
+// the ship is now in in_state, from this frame on
+void exp_rules::enter(int in_state)
+{
+  state=in_state;
+  frames=0;
+  next_deadline();
+}
+
+void exp_rules::flag(int id, int on)
+{
+  flags[id]=on;
+}
+
+// the first time rule of state still ahead, if any
+void exp_rules::next_deadline()
+{
+  deadline=0;
+  if(state<0)
+    return;
+  std::vector<exp_rule>& list=times[state];
+  for(int f=0; f<list.size() && !deadline; f++)
+    if(list[f].value>frames)
+      deadline=list[f].value;
+}
+
+// the time rules due this frame
+void exp_rules::reach()
+{
+  std::vector<exp_rule>& list=times[state];
+  for(int f=0; f<list.size() && list[f].value<=frames; f++)
+    if(list[f].value==frames && (list[f].flag<0 || !flags[list[f].flag]==!list[f].flag_on))
+      win(list,f--);
+  next_deadline();
+}
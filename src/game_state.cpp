@@ -0,0 +1,766 @@
+#include <cstdlib>
+#include <vector>
+#include "../inc/game_state.h"
+
+game_state::game_state()
+  : gold_list(COMP_POS|COMP_STATE),
+    bug_list(COMP_POS|COMP_DIR),
+    green_list(COMP_POS|COMP_FRAME),
+    cloud_list(COMP_POS|COMP_FRAME),
+    bug_hash(0,48,320,180,16)
+{
+  rng=1;
+  autopilot_bugs=0;
+  treasure_count=4;
+  cloud_count=5;
+  plant_count=-1;
+  collisions=1;
+  ship_mask=NULL;
+  bug_mask=NULL;
+  gold_mask=NULL;
+  level=0;
+  score=0;
+  ship_disabled=false;
+  ship_x=0;
+  ship_y=0;
+  ship_ah=0;
+  ship_av=0;
+  ship_load=0;
+  engine_on=false;
+  caught=0;
+  depth=DEPTH_SURFACE;
+  water_wave=0;
+}
+
+game_state::~game_state()
+{
+}
+
+void game_state::seed(unsigned int s)
+{
+  rng=s;
+}
+
+// 0..32767 like rand(), the same sequence on every platform
+int game_state::random()
+{
+  rng=rng*1103515245+12345;
+  return (rng>>16)&0x7fff;
+}
+
+void game_state::event(int type, int value)
+{
+  game_event e;
+  e.type=type;
+  e.value=value;
+  events.push_back(e);
+}
+
+void game_state::new_bubble(int x, int y, int dir)
+{
+  bubble_base b;
+  b.x=x-4+random()%9;
+  b.y=y-4+random()%9;
+  switch(dir)
+  {
+    case DIR_DOWN:
+      b.av=random()%5;
+      b.ah=random()%2;
+      break;
+    case DIR_LEFT:
+      b.av=random()%2;
+      b.ah=-random()%5;
+      break;
+    case DIR_RIGHT:
+      b.av=random()%2;
+      b.ah=random()%5;
+      break;
+  }
+
+  bubble_list.push_back(b);
+  if(random()%6==0)
+    event(EVENT_BUBBLE,0);
+}
+
+void game_state::new_bug()
+{
+  int i=bug_list.spawn_range(1);
+  int x=random()%298;
+  int y=72+random()%132;
+  int dir_x=0;
+  int dir_y=0;
+  while(dir_x==0 && dir_y==0)
+  {
+    dir_x=-1+random()%3;
+    dir_y=-1+random()%3;
+  }
+  if(x>130 && x<190 && y<100 && dir_y<0)
+    dir_y=-dir_y;
+
+  bug_list.x[i]=x;
+  bug_list.y[i]=y;
+  bug_list.dir_x[i]=dir_x;
+  bug_list.dir_y[i]=dir_y;
+  bug_hash.insert(bug_list.handle(i),x,y);
+}
+
+void game_state::new_level()
+{
+  // create treasures
+  gold_list.clear();
+  int first=gold_list.spawn_range(treasure_count);
+  int space=320/treasure_count;
+  for(int i=0; i<treasure_count; i++)
+  {
+    gold_list.x[first+i]=space*i+(space-24)/2;
+    gold_list.y[first+i]=228;
+    gold_list.state[first+i]=0;
+  }
+  // add a new bug
+  new_bug();
+  // inc level
+  level++;
+}
+
+void game_state::reset()
+{
+  level=0;
+  score=0;
+  ship_x=148;
+  ship_y=48;
+  ship_ah=0;
+  ship_av=0;
+  ship_load=0;
+  caught=0;
+
+  bug_list.clear();
+  bug_hash.clear();
+  new_bug();
+  new_bug();
+  bubble_list.clear();
+  green_list.clear();
+  cloud_list.clear();
+
+  depth=DEPTH_SURFACE;
+
+  // plants
+  for(int f=0; plant_count<0;)
+  {
+    int i=green_list.spawn_range(1);
+    green_list.y[i]=212;
+    green_list.x[i]=f;
+    f+=6+random()%8;
+    green_list.frame[i]=random()%4;
+    if(f>312)
+      break;
+  }
+  int first=green_list.spawn_range(plant_count>0 ? plant_count : 0);
+  for(int i=first; i<green_list.size(); i++)
+  {
+    green_list.y[i]=212;
+    green_list.x[i]=random()%313;
+    green_list.frame[i]=random()%4;
+  }
+  // clouds
+  first=cloud_list.spawn_range(cloud_count);
+  for(int i=first; i<cloud_list.size(); i++)
+  {
+    cloud_list.y[i]=-16+random()%16;
+    cloud_list.x[i]=random()%320;
+    if(random()%2==0)
+      cloud_list.frame[i]=1;
+    else
+      cloud_list.frame[i]=-1;
+    cloud_list.vel[i]=FX(0.1)+fixed(random()%10)/10;
+  }
+}
+
+// does the bug at x,y touch the bathyscaphe or the treasure it carries
+int game_state::ship_hit(int x, int y)
+{
+  if(!ship_mask || !bug_mask || ship_mask->empty() || bug_mask->empty())
+    return x>ship_x-20 && x<ship_x+20 && y>ship_y-20 && y<ship_y+20;
+
+  if(bug_mask->overlap(x,y,*ship_mask,ship_x,ship_y))
+    return 1;
+  if(ship_load && gold_mask && !gold_mask->empty())
+  {
+    for(int i=0; i<gold_list.size(); i++)
+      if(gold_list.state[i] && bug_mask->overlap(x,y,*gold_mask,gold_list.x[i],gold_list.y[i]))
+        return 1;
+  }
+  return 0;
+}
+
+void game_state::update()
+{
+  move_ship();
+  move_bugs(0,bug_list.size());
+  move_bug_hash();
+  move_bubbles();
+  move_plants(0,green_list.size());
+  move_clouds(0,cloud_list.size());
+  end_update();
+}
+
+void game_state::move_ship()
+{
+  if(!ship_disabled)
+  {
+    // ship impulse
+    ship_y+=ship_av.to_int();
+    ship_x+=ship_ah.to_int();
+    if(ship_x<0)
+      ship_x=0;
+    if(ship_x>296)
+      ship_x=296;
+    if(ship_y<48)
+    {
+      ship_y=48;
+      ship_av=FX(0.1);
+    }
+    if(ship_y>204)
+    {
+      ship_y=204;
+      ship_av=0;
+    }
+  }
+}
+
+void game_state::move_bugs(int begin, int end)
+{
+  for(int i=begin; i<end; i++)
+  {
+    bug_list.x[i]+=bug_list.dir_x[i];
+    bug_list.y[i]+=bug_list.dir_y[i];
+    if(bug_list.x[i]<0 || bug_list.x[i]>298)
+      bug_list.dir_x[i]=-bug_list.dir_x[i];
+    if(bug_list.y[i]<48 || bug_list.y[i]>204)
+      bug_list.dir_y[i]=-bug_list.dir_y[i];
+  }
+}
+
+void game_state::move_bug_hash()
+{
+  for(int i=0; i<bug_list.size(); i++)
+    bug_hash.move(bug_list.handle(i),bug_list.x[i],bug_list.y[i]);
+}
+
+void game_state::move_bubbles()
+{
+  for(int i=0; i<bubble_list.size(); i++)
+  {
+    bubble_list[i].x+=bubble_list[i].ah.to_int()-1+random()%3;
+    bubble_list[i].y+=bubble_list[i].av.to_int();
+    if(bubble_list[i].ah<0)
+      bubble_list[i].ah+=FX(0.3);
+    if(bubble_list[i].ah>0)
+      bubble_list[i].ah-=FX(0.3);
+    if(bubble_list[i].av>-1)
+      bubble_list[i].av-=FX(0.3);
+    if(bubble_list[i].y<48)
+    {
+      bubble_list.erase(bubble_list.begin()+i);
+      i--;
+    }
+  }
+}
+
+void game_state::move_plants(int begin, int end)
+{
+  for(int i=begin; i<end; i++)
+  {
+    green_list.frame[i]+=FX(0.2);
+    if(green_list.frame[i]>FX(3.9))
+      green_list.frame[i]=0;
+  }
+}
+
+void game_state::move_clouds(int begin, int end)
+{
+  for(int i=begin; i<end; i++)
+  {
+    if(cloud_list.frame[i]>0)
+    {
+      cloud_list.frame[i]+=cloud_list.vel[i];
+      if(cloud_list.frame[i]>FX(3.9))
+      {
+        cloud_list.frame[i]=FX(0.1);
+        cloud_list.x[i]+=1;
+        if(cloud_list.x[i]>319)
+          cloud_list.x[i]=-48;
+      }
+    }
+    else
+    {
+      cloud_list.frame[i]-=cloud_list.vel[i];
+      if(cloud_list.frame[i]<-FX(3.9))
+      {
+        cloud_list.frame[i]=-FX(0.1);
+        cloud_list.x[i]-=1;
+        if(cloud_list.x[i]<-48)
+          cloud_list.x[i]=320;
+      }
+    }
+  }
+}
+
+void game_state::end_update()
+{
+  // check if get treasure
+  for(int i=0; i<gold_list.size(); i++)
+  {
+    if(gold_list.state[i])
+    {
+      gold_list.x[i]=ship_x;
+      gold_list.y[i]=ship_y+24;
+    }
+    if(!ship_load && ship_y>=204 && ship_x>gold_list.x[i]-4 && ship_x<gold_list.x[i]+4)
+    {
+      gold_list.state[i]=1;
+      ship_load=1;
+      event(EVENT_HIT,0);
+    }
+  }
+
+  // check if rescue treasure
+  if(ship_load && ship_y<=48 && ship_x>=136 && ship_x<160)
+  {
+    for(int i=gold_list.size()-1; i>=0; i--)
+    {
+      if(gold_list.state[i])
+      {
+        gold_list.despawn_index(i);
+        ship_load=0;
+        score++;
+        event(EVENT_GOLD,score);
+      }
+    }
+  }
+
+  // if get all treasures, advance to next level
+  if(gold_list.size()==0)
+    new_level();
+
+  // check collision, the hash gives the bugs near the ship and its load;
+  // without collisions the tests still run, a hit is only not taken
+  if(!ship_disabled)
+  {
+    bug_hash.query_rect(ship_x-23,ship_y-23,ship_x+23,ship_y+35,bug_query);
+    for(int f=0; f<bug_query.size(); f++)
+    {
+      int i=bug_list.index(bug_query[f]);
+      if(ship_hit(bug_list.x[i],bug_list.y[i]) && collisions)
+      {
+        caught=1;
+        event(EVENT_ROAR,score);
+        break;
+      }
+    }
+  }
+
+  // the exp rules time the ship at each depth
+  int now=ship_y==48 ? DEPTH_SURFACE : ship_y==204 ? DEPTH_FLOOR : DEPTH_WATER;
+  if(now!=depth)
+  {
+    depth=now;
+    event(EVENT_DEPTH,depth);
+  }
+
+  water_wave+=FX(0.4);
+  if(water_wave>=40)
+    water_wave=0;
+}
+
+// thrust and left/right keys held this frame
+void game_state::control(int thrust, int left, int right)
+{
+  if(thrust)
+  {
+    if(!ship_disabled)
+    {
+      if(ship_av>-4)
+        ship_av-=FX(0.1);
+      if(!engine_on)
+      {
+        event(EVENT_ENGINE_ON,0);
+        engine_on=true;
+      }
+    }
+    if(random()%3==0)
+      new_bubble(ship_x+12,ship_y+22,DIR_DOWN);
+  }
+  else
+  {
+    if(!ship_disabled)
+      if(ship_av<4)
+        ship_av+=FX(0.1);
+    if(engine_on)
+    {
+      event(EVENT_ENGINE_OFF,0);
+      engine_on=false;
+    }
+  }
+
+  if(left)
+  {
+    if(!ship_disabled)
+      if(ship_ah>-4)
+        ship_ah-=FX(0.1);
+    if(random()%3==0)
+      new_bubble(ship_x+22,ship_y+7,DIR_RIGHT);
+  }
+  if(right)
+  {
+    if(!ship_disabled)
+      if(ship_ah<4)
+        ship_ah+=FX(0.1);
+    if(random()%3==0)
+      new_bubble(ship_x+2,ship_y+7,DIR_LEFT);
+  }
+
+  if(!left && ship_ah<0 && !ship_disabled)
+    ship_ah+=FX(0.1);
+
+  if(!right && ship_ah>0 && !ship_disabled)
+    ship_ah-=FX(0.1);
+}
+
+///////////////////////////////////
+/*  Autopilot                    */
+///////////////////////////////////
+int game_state::autopilot_target()
+{
+  int target_x=148;   // the boat
+  if(!ship_load)
+  {
+    int best=-1;
+    for(int i=0; i<gold_list.size(); i++)
+    {
+      int d=abs(gold_list.x[i]-ship_x);
+      if(best<0 || d<best)
+      {
+        best=d;
+        target_x=gold_list.x[i];
+      }
+    }
+  }
+  return target_x;
+}
+
+// keys for a plan; cruising goes down to the treasures or up to the boat at
+// half speed, and to the target at a speed that stops the ship over it
+void game_state::autopilot_keys(int x, fixed ah, fixed av, int target_x, int vplan, int hplan, int& up, int& left, int& right)
+{
+  if(vplan==PLAN_CRUISE)
+    up=ship_load ? av>-2 : av>2;
+  else
+    up=(vplan==PLAN_UP);
+
+  if(hplan==PLAN_CRUISE)
+  {
+    // fast enough to move at least a pixel per frame until over the target
+    int d=target_x-x;
+    fixed want=fixed(d)/8;
+    if(want>4)
+      want=4;
+    if(want<-4)
+      want=-4;
+    if(d>2 && want<FX(1.5))
+      want=FX(1.5);
+    if(d<-2 && want>-FX(1.5))
+      want=-FX(1.5);
+    if(d>=-2 && d<=2)
+      want=0;
+    left=ah>want+FX(0.1);
+    right=ah<want-FX(0.1);
+  }
+  else
+  {
+    left=(hplan==PLAN_LEFT);
+    right=(hplan==PLAN_RIGHT);
+  }
+}
+
+// where the bugs near the ship will be in each of the next frames
+void game_state::autopilot_track_bugs()
+{
+  int reach=28+AUTOPILOT_AHEAD*5;
+  bug_hash.query_rect(ship_x-reach,ship_y-reach,ship_x+reach,ship_y+reach,bug_query);
+  autopilot_bugs=bug_query.size();
+  autopilot_bug_x.resize(autopilot_bugs*AUTOPILOT_AHEAD);
+  autopilot_bug_y.resize(autopilot_bugs*AUTOPILOT_AHEAD);
+  for(int f=0; f<autopilot_bugs; f++)
+  {
+    int i=bug_list.index(bug_query[f]);
+    int x=bug_list.x[i];
+    int y=bug_list.y[i];
+    int dir_x=bug_list.dir_x[i];
+    int dir_y=bug_list.dir_y[i];
+    for(int t=0; t<AUTOPILOT_AHEAD; t++)
+    {
+      x+=dir_x;
+      y+=dir_y;
+      if(x<0 || x>298)
+        dir_x=-dir_x;
+      if(y<48 || y>204)
+        dir_y=-dir_y;
+      autopilot_bug_x[t*autopilot_bugs+f]=x;
+      autopilot_bug_y[t*autopilot_bugs+f]=y;
+    }
+  }
+}
+
+// frames the ship flies a plan before it comes close to a bug,
+// AUTOPILOT_AHEAD if it keeps clear
+int game_state::autopilot_clear(int target_x, int vplan, int hplan)
+{
+  int x=ship_x;
+  int y=ship_y;
+  fixed ah=ship_ah;
+  fixed av=ship_av;
+  int below=ship_load ? 52 : 28;    // the treasure hangs under the ship
+  for(int t=0; t<AUTOPILOT_AHEAD; t++)
+  {
+    // as move_ship() and control() do
+    int up, left, right;
+    autopilot_keys(x,ah,av,target_x,vplan,hplan,up,left,right);
+    if(up && av>-4)
+      av-=FX(0.1);
+    if(!up && av<4)
+      av+=FX(0.1);
+    if(left && ah>-4)
+      ah-=FX(0.1);
+    if(right && ah<4)
+      ah+=FX(0.1);
+    if(!left && ah<0)
+      ah+=FX(0.1);
+    if(!right && ah>0)
+      ah-=FX(0.1);
+    x+=ah.to_int();
+    y+=av.to_int();
+    if(x<0)
+      x=0;
+    if(x>296)
+      x=296;
+    if(y<48)
+    {
+      y=48;
+      av=FX(0.1);
+    }
+    if(y>204)
+    {
+      y=204;
+      av=0;
+    }
+
+    for(int f=0; f<autopilot_bugs; f++)
+    {
+      int bx=autopilot_bug_x[t*autopilot_bugs+f]-x;
+      int by=autopilot_bug_y[t*autopilot_bugs+f]-y;
+      if(bx>-28 && bx<28 && by>-28 && by<below)
+        return t;
+    }
+  }
+  return AUTOPILOT_AHEAD;
+}
+
+// steer to the nearest treasure, then back to the boat; when that course
+// runs into a bug, fly the plan that keeps clear the longest
+void game_state::autopilot(int avoid_bugs, int& thrust, int& left, int& right)
+{
+  int target_x=autopilot_target();
+  int vplan=PLAN_CRUISE;
+  int hplan=PLAN_CRUISE;
+  if(avoid_bugs)
+  {
+    autopilot_track_bugs();
+    int best=autopilot_clear(target_x,PLAN_CRUISE,PLAN_CRUISE);
+    for(int v=0; v<3 && best<AUTOPILOT_AHEAD; v++)
+    {
+      for(int h=0; h<4 && best<AUTOPILOT_AHEAD; h++)
+      {
+        int clear=autopilot_clear(target_x,v,h);
+        if(clear>best)
+        {
+          best=clear;
+          vplan=v;
+          hplan=h;
+        }
+      }
+    }
+  }
+
+  autopilot_keys(ship_x,ship_ah,ship_av,target_x,vplan,hplan,thrust,left,right);
+}
+
+///////////////////////////////////
+/*  Save and load                */
+///////////////////////////////////
+#define SAVE_SCALARS  13
+
+// append a section of count ints; returns where it starts
+static int save_section(std::vector<int>& out, int& section, int count)
+{
+  out[1+section]=count;
+  section++;
+  int at=out.size();
+  out.resize(at+count);
+  return at;
+}
+
+static void save_ints(std::vector<int>& out, int& section, const std::vector<int>& v)
+{
+  int at=save_section(out,section,v.size());
+  for(int i=0; i<v.size(); i++)
+    out[at+i]=v[i];
+}
+
+static void save_fixed(std::vector<int>& out, int& section, const std::vector<fixed>& v)
+{
+  int at=save_section(out,section,v.size());
+  for(int i=0; i<v.size(); i++)
+    out[at+i]=v[i].get_raw();
+}
+
+void game_state::save(std::vector<int>& out)
+{
+  out.resize(1+SAVE_SECTIONS);
+  out[0]=SAVE_SECTIONS;
+  int section=0;
+
+  int at=save_section(out,section,SAVE_SCALARS);
+  out[at++]=(int)rng;
+  out[at++]=level;
+  out[at++]=score;
+  out[at++]=ship_disabled;
+  out[at++]=ship_x;
+  out[at++]=ship_y;
+  out[at++]=ship_ah.get_raw();
+  out[at++]=ship_av.get_raw();
+  out[at++]=ship_load;
+  out[at++]=engine_on;
+  out[at++]=caught;
+  out[at++]=depth;
+  out[at++]=water_wave.get_raw();
+
+  save_ints(out,section,gold_list.x);
+  save_ints(out,section,gold_list.y);
+  save_ints(out,section,gold_list.state);
+  save_ints(out,section,bug_list.x);
+  save_ints(out,section,bug_list.y);
+  save_ints(out,section,bug_list.dir_x);
+  save_ints(out,section,bug_list.dir_y);
+  save_ints(out,section,green_list.x);
+  save_ints(out,section,green_list.y);
+  save_fixed(out,section,green_list.frame);
+  save_ints(out,section,cloud_list.x);
+  save_ints(out,section,cloud_list.y);
+  save_fixed(out,section,cloud_list.frame);
+  save_fixed(out,section,cloud_list.vel);
+
+  // bubbles come and go the most, so they go last
+  int count=bubble_list.size();
+  int x=save_section(out,section,count);
+  int y=save_section(out,section,count);
+  int ah=save_section(out,section,count);
+  int av=save_section(out,section,count);
+  for(int i=0; i<count; i++)
+  {
+    out[x+i]=bubble_list[i].x;
+    out[y+i]=bubble_list[i].y;
+    out[ah+i]=bubble_list[i].ah.get_raw();
+    out[av+i]=bubble_list[i].av.get_raw();
+  }
+}
+
+// refill a store from the next sections, components in save() order
+static void load_store(entity_store& store, const int*& size, const int*& p, int comp)
+{
+  int count=size[0];
+  store.clear();
+  store.spawn_range(count);
+  for(int i=0; i<count; i++)
+  {
+    store.x[i]=p[i];
+    store.y[i]=p[count+i];
+  }
+  p+=2*count;
+  size+=2;
+  if(comp&COMP_STATE)
+  {
+    for(int i=0; i<count; i++)
+      store.state[i]=p[i];
+    p+=count;
+    size++;
+  }
+  if(comp&COMP_DIR)
+  {
+    for(int i=0; i<count; i++)
+    {
+      store.dir_x[i]=p[i];
+      store.dir_y[i]=p[count+i];
+    }
+    p+=2*count;
+    size+=2;
+  }
+  if(comp&COMP_FRAME)
+  {
+    for(int i=0; i<count; i++)
+      store.frame[i]=fixed::from_raw(p[i]);
+    p+=count;
+    size++;
+  }
+}
+
+// 0 if in is not a state save() wrote
+int game_state::load(const std::vector<int>& in)
+{
+  if(in.size()<1+SAVE_SECTIONS || in[0]!=SAVE_SECTIONS || in[1]!=SAVE_SCALARS)
+    return 0;
+  int total=0;
+  for(int f=0; f<SAVE_SECTIONS; f++)
+    total+=in[1+f];
+  if(in.size()!=1+SAVE_SECTIONS+total)
+    return 0;
+
+  const int* size=&in[2];
+  const int* p=&in[1+SAVE_SECTIONS];
+  rng=(unsigned int)*p++;
+  level=*p++;
+  score=*p++;
+  ship_disabled=*p++;
+  ship_x=*p++;
+  ship_y=*p++;
+  ship_ah=fixed::from_raw(*p++);
+  ship_av=fixed::from_raw(*p++);
+  ship_load=*p++;
+  engine_on=*p++;
+  caught=*p++;
+  depth=*p++;
+  water_wave=fixed::from_raw(*p++);
+
+  load_store(gold_list,size,p,COMP_STATE);
+  load_store(bug_list,size,p,COMP_DIR);
+  load_store(green_list,size,p,COMP_FRAME);
+  load_store(cloud_list,size,p,COMP_FRAME);
+  for(int i=0; i<cloud_list.size(); i++)
+    cloud_list.vel[i]=fixed::from_raw(p[i]);
+  p+=size[0];
+  size++;
+
+  int count=size[0];
+  bubble_list.resize(count);
+  for(int i=0; i<count; i++)
+  {
+    bubble_list[i].x=p[i];
+    bubble_list[i].y=p[count+i];
+    bubble_list[i].ah=fixed::from_raw(p[2*count+i]);
+    bubble_list[i].av=fixed::from_raw(p[3*count+i]);
+  }
+
+  bug_hash.clear();
+  for(int i=0; i<bug_list.size(); i++)
+    bug_hash.insert(bug_list.handle(i),bug_list.x[i],bug_list.y[i]);
+  return 1;
+}
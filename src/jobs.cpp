@@ -0,0 +1,327 @@
+#ifdef PLATFORM_WIN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <deque>
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+#include "../inc/jobs.h"
+
+int cpu_count()
+{
+#ifdef PLATFORM_WIN
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+#else
+  int n=sysconf(_SC_NPROCESSORS_ONLN);
+  if(n<1)
+    n=1;
+  return n;
+#endif
+}
+
+job_system::job_system()
+{
+  job_count=0;
+  worker_count=0;
+  running=0;
+  queued=0;
+  lock=NULL;
+  wake=NULL;
+  for(int f=0; f<JOB_MAX_THREADS; f++)
+  {
+    queue_lock[f]=NULL;
+    thread[f]=NULL;
+  }
+}
+
+job_system::~job_system()
+{
+  stop();
+}
+
+// start worker threads besides the calling one, 0 runs every job in wait()
+void job_system::start(int threads)
+{
+  if(threads>JOB_MAX_THREADS-1)
+    threads=JOB_MAX_THREADS-1;
+  if(threads<0)
+    threads=0;
+
+  lock=SDL_CreateMutex();
+  wake=SDL_CreateCond();
+  for(int f=0; f<=threads; f++)
+  {
+    queue_lock[f]=SDL_CreateMutex();
+    worker[f].system=this;
+    worker[f].index=f;
+  }
+  worker_count=threads+1;
+  running=1;
+  for(int f=1; f<worker_count; f++)
+    thread[f]=SDL_CreateThread(worker_main,&worker[f]);
+}
+
+void job_system::stop()
+{
+  if(!running)
+    return;
+
+  SDL_mutexP(lock);
+  running=0;
+  SDL_CondBroadcast(wake);
+  SDL_mutexV(lock);
+  for(int f=1; f<worker_count; f++)
+  {
+    SDL_WaitThread(thread[f],NULL);
+    thread[f]=NULL;
+  }
+  for(int f=0; f<worker_count; f++)
+  {
+    SDL_DestroyMutex(queue_lock[f]);
+    queue_lock[f]=NULL;
+  }
+  SDL_DestroyCond(wake);
+  SDL_DestroyMutex(lock);
+  wake=NULL;
+  lock=NULL;
+  worker_count=0;
+}
+
+int job_system::threads()
+{
+  return worker_count;
+}
+
+int job_system::worker_main(void* data)
+{
+  job_worker* w=(job_worker*)data;
+  job_system* js=w->system;
+
+  for(;;)
+  {
+    int id=js->pop(w->index);
+    if(id>=0)
+    {
+      js->run(w->index,id);
+      continue;
+    }
+    SDL_mutexP(js->lock);
+    while(js->running && js->queued==0)
+      SDL_CondWait(js->wake,js->lock);
+    int quit=!js->running;
+    SDL_mutexV(js->lock);
+    if(quit)
+      break;
+  }
+  return 0;
+}
+
+int job_system::alloc(job_func func, void* data, int begin, int end)
+{
+  if(job_count>=JOB_MAX)
+    return -1;
+
+  int id=job_count++;
+  job& j=job_list[id];
+  j.func=func;
+  j.data=data;
+  j.begin=begin;
+  j.end=end;
+  j.pending=1;
+  j.unfinished=0;
+  j.parent=-1;
+  j.first_part=0;
+  j.parts=0;
+  j.next.clear();
+  j.done=0;
+  return id;
+}
+
+// new job, it runs once submitted and all its dependencies are done
+int job_system::create(job_func func, void* data, int begin, int end)
+{
+  int id=alloc(func,data,begin,end);
+  // pool exhausted: do the work now rather than lose it, though not after
+  // what it would have depended on
+  if(id<0 && func)
+    func(data,begin,end);
+  return id;
+}
+
+// job that runs func over [0,count) split in parts of about grain items
+int job_system::parallel_for(job_func func, void* data, int count, int grain)
+{
+  if(grain<1)
+    grain=1;
+  int parts=(count+grain-1)/grain;
+  if(parts>JOB_MAX_PARTS)
+    parts=JOB_MAX_PARTS;
+  // pool exhausted: as in create()
+  if(job_count+parts+1>JOB_MAX)
+  {
+    if(count>0)
+      func(data,0,count);
+    return -1;
+  }
+
+  int id=alloc(NULL,NULL,0,count);
+  job_list[id].first_part=job_count;
+  job_list[id].parts=parts;
+  for(int f=0; f<parts; f++)
+  {
+    int part=alloc(func,data,count*f/parts,count*(f+1)/parts);
+    job_list[part].pending=0;
+    job_list[part].parent=id;
+  }
+  return id;
+}
+
+// id will not start before on is done; call before id is submitted
+void job_system::depend(int id, int on)
+{
+  if(id<0 || on<0)
+    return;
+
+  SDL_mutexP(lock);
+  job& j=job_list[on];
+  if(!j.done)
+  {
+    j.next.push_back(id);
+    job_list[id].pending++;
+  }
+  SDL_mutexV(lock);
+}
+
+void job_system::submit(int id)
+{
+  if(id<0)
+    return;
+
+  SDL_mutexP(lock);
+  int ready=(--job_list[id].pending==0);
+  SDL_mutexV(lock);
+  if(ready)
+    push(0,id);
+}
+
+void job_system::push(int w, int id)
+{
+  SDL_mutexP(queue_lock[w]);
+  queue[w].push_back(id);
+  SDL_mutexV(queue_lock[w]);
+
+  SDL_mutexP(lock);
+  queued++;
+  SDL_CondBroadcast(wake);
+  SDL_mutexV(lock);
+}
+
+// newest job of our own deque, else the oldest of someone else's
+int job_system::pop(int w)
+{
+  int id=-1;
+  for(int f=0; f<worker_count && id<0; f++)
+  {
+    int victim=(w+f)%worker_count;
+    SDL_mutexP(queue_lock[victim]);
+    if(queue[victim].size()>0)
+    {
+      if(victim==w)
+      {
+        id=queue[victim].back();
+        queue[victim].pop_back();
+      }
+      else
+      {
+        id=queue[victim].front();
+        queue[victim].pop_front();
+      }
+    }
+    SDL_mutexV(queue_lock[victim]);
+  }
+
+  if(id>=0)
+  {
+    SDL_mutexP(lock);
+    queued--;
+    SDL_mutexV(lock);
+  }
+  return id;
+}
+
+void job_system::run(int w, int id)
+{
+  job& j=job_list[id];
+  if(j.func)
+    j.func(j.data,j.begin,j.end);
+  if(j.parts>0)
+  {
+    SDL_mutexP(lock);
+    j.unfinished=j.parts;
+    SDL_mutexV(lock);
+    for(int f=0; f<j.parts; f++)
+      push(w,j.first_part+f);
+  }
+  else
+    complete(w,id);
+}
+
+void job_system::complete(int w, int id)
+{
+  std::vector<int> ready;
+  int parent_done=-1;
+
+  SDL_mutexP(lock);
+  job& j=job_list[id];
+  j.done=1;
+  for(int f=0; f<(int)j.next.size(); f++)
+    if(--job_list[j.next[f]].pending==0)
+      ready.push_back(j.next[f]);
+  if(j.parent>=0)
+    if(--job_list[j.parent].unfinished==0)
+      parent_done=j.parent;
+  SDL_CondBroadcast(wake);
+  SDL_mutexV(lock);
+
+  for(int f=0; f<(int)ready.size(); f++)
+    push(w,ready[f]);
+  if(parent_done>=0)
+    complete(w,parent_done);
+}
+
+// run jobs on the calling thread until id is done
+void job_system::wait(int id)
+{
+  if(id<0)
+    return;
+
+  for(;;)
+  {
+    SDL_mutexP(lock);
+    int done=job_list[id].done;
+    SDL_mutexV(lock);
+    if(done)
+      return;
+
+    int other=pop(0);
+    if(other>=0)
+    {
+      run(0,other);
+      continue;
+    }
+
+    SDL_mutexP(lock);
+    while(!job_list[id].done && queued==0)
+      SDL_CondWait(wake,lock);
+    SDL_mutexV(lock);
+  }
+}
+
+// forget all jobs; only once everything created has been waited for
+void job_system::clear()
+{
+  job_count=0;
+}
@@ -1,13 +1,115 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <fstream>
-#include <dirent.h>
+#include <sstream>
+#include "../inc/asset_pack.h"
 #include "../inc/language.h"
 
+// how lines are cut, which a .langc is only good for
+#ifdef PLATFORM_GP2X
+#define LANGC_RULE      1         // the last character of each line dropped
+#endif
+#ifdef PLATFORM_WIN
+#define LANGC_RULE      0
+#endif
+
+static long read_u32(const unsigned char* p)
+{
+  return (long)p[0]|((long)p[1]<<8)|((long)p[2]<<16)|((long)p[3]<<24);
+}
+
+static void put_u32(std::vector<unsigned char>& out, long v)
+{
+  out.push_back(v&0xff);
+  out.push_back((v>>8)&0xff);
+  out.push_back((v>>16)&0xff);
+  out.push_back((v>>24)&0xff);
+}
+
+// FNV-1a over 32-bit words rather than bytes, a quarter of the multiplies;
+// only ever compared with itself
+static unsigned int text_hash(const char* data, long size)
+{
+  const unsigned char* p=(const unsigned char*)data;
+  unsigned int h=2166136261u^size;
+  long f=0;
+  for(; f+4<=size; f+=4)
+  {
+    h^=(unsigned int)read_u32(p+f);
+    h*=16777619u;
+  }
+  for(; f<size; f++)
+  {
+    h^=p[f];
+    h*=16777619u;
+  }
+  return h;
+}
+
+// 1 if s converts nothing but, at most once, an int with %i or %d
+static int int_format(const char* s)
+{
+  int conversions=0;
+  for(; *s; s++)
+  {
+    if(*s!='%')
+      continue;
+    s++;
+    if(*s=='%')
+      continue;
+    while(*s && strchr("-+ #0",*s))
+      s++;
+    while(*s>='0' && *s<='9')
+      s++;
+    if(*s=='.')
+      s++;
+    while(*s>='0' && *s<='9')
+      s++;
+    if(*s!='i' && *s!='d')
+      return 0;
+    conversions++;
+  }
+  return conversions<=1;
+}
+
+// 1 if p is a .langc of the .lang hashed, made here, with every string in it
+static int is_compiled(const unsigned char* p, long size, unsigned int hash)
+{
+  if(!p || size<=LANGC_HEADER || memcmp(p,LANGC_MAGIC,4) || read_u32(p+4)!=LANGC_VERSION ||
+     (unsigned int)read_u32(p+8)!=hash || read_u32(p+12)!=LANGC_RULE || p[size-1]!=0)
+    return 0;
+  long count=read_u32(p+16);
+  if(count<0 || count>(size-LANGC_HEADER)/LANGC_ENTRY)
+    return 0;
+  long first=LANGC_HEADER+count*LANGC_ENTRY;
+  if(read_u32(p+20)<first || read_u32(p+20)>=size || read_u32(p+24)<first || read_u32(p+24)>=size)
+    return 0;
+  for(long f=0; f<count; f++)
+  {
+    long offset=read_u32(p+LANGC_HEADER+f*LANGC_ENTRY);
+    if(offset && (offset<first || offset>=size))
+      return 0;
+  }
+  return 1;
+}
+
+static int write_file(const std::string& path, const unsigned char* data, long size)
+{
+  FILE* file=fopen(path.c_str(),"wb");
+  if(!file)
+    return 0;
+  int ok=fwrite(data,size,1,file)==1;
+  return !fclose(file) && ok;
+}
+
 language::language()
 {
   id_language=0;
-  read_languages();
+  strings=NULL;
+  files=NULL;
   nullstring=0;
 }
 
@@ -15,94 +117,218 @@ language::~language()
 {
 }
 
-std::string language::read_name(std::string file_name)
+// the .lang, out of the pack or read from disk, and its hash
+int language::read_file(lang_file& file)
 {
-  std::ifstream file;
-  std::string name;
+  std::string filename="lang/"+file.file;
+  file.data=(const char*)files->map(filename.c_str(),file.size);
+  if(!file.data)
+  {
+    std::ifstream in(filename.c_str(),std::ios::in|std::ios::binary);
+    if(!in)
+      return 0;
+    std::ostringstream buffer;
+    buffer<<in.rdbuf();
+    file.text=buffer.str();
+    file.size=file.text.size();
+  }
+  file.hash=text_hash(file.data ? file.data : file.text.data(),file.size);
+  return 1;
+}
 
-  std::string filename="lang/"+file_name;
-  file.open(filename.c_str());
-  if(file)
+// scan the .lang once for its name, its author and where each string lies
+void language::parse(lang_file& file)
+{
+  const char* text=file.data ? file.data : file.text.data();
+  long size=file.size;
+
+  // a field not there takes the value of the last line
+  int lang_found=0;
+  int author_found=0;
+  int pos=0;
+  while(pos<size)
   {
-    char buffer[1024];
-    std::string bfline;
-    std::string code;
-    while(file.getline(buffer,1024))
-    {
-      bfline=buffer;
-      int i=bfline.find(" ",1);
-      code=bfline.substr(0,i);
+    const char* eol=(const char*)memchr(text+pos,'\n',size-pos);
+    int end=eol ? eol-text : size;
+    int line=pos;
+    int len=end-pos;
+    pos=end+1;
+#ifdef PLATFORM_WIN
+    // text mode
+    if(len>0 && text[line+len-1]=='\r')
+      len--;
+#endif
+    // the code runs to the first space after its first character
+    int i=-1;
+    for(int c=1; c<len; c++)
+      if(text[line+c]==' ')
+      {
+        i=c;
+        break;
+      }
+    int code_len=i<0 ? len : i;
 #ifdef PLATFORM_GP2X
-      name=bfline.substr(i+1,bfline.size()-i-2);
+    int value_len=len-i-2;
 #endif
 #ifdef PLATFORM_WIN
-      name=bfline.substr(i+1,bfline.size()-i-1);
+    int value_len=len-i-1;
 #endif
-      if(code.substr(0,1)=="@")
-        if(code.substr(1)=="lang")
-          break;
+    if(value_len<0)
+      value_len=0;
+    const char* code=text+line;
+    const char* value=text+line+i+1;
+
+    int is_lang=code_len==5 && !strncmp(code,"@lang",5);
+    int is_author=code_len==7 && !strncmp(code,"@author",7);
+    if(!lang_found)
+      file.lang.assign(value,value_len);
+    if(!author_found)
+      file.author.assign(value,value_len);
+    lang_found|=is_lang;
+    author_found|=is_author;
+    if(code_len>0 && code[0]=='@' && !is_lang)
+    {
+      char id[16];
+      int id_len=code_len-1<15 ? code_len-1 : 15;
+      memcpy(id,code+1,id_len);
+      id[id_len]=0;
+      lang_entry e;
+      e.id=atoi(id);
+      e.start=value-text;
+      e.length=value_len;
+      if(e.id>=0)
+        file.entries.push_back(e);
     }
   }
-  file.close();
+}
 
-  return name;
+// the .langc, from the pack or else from disk, if it is of this .lang
+int language::read_compiled(lang_file& file)
+{
+  std::string filename="lang/"+file.file+"c";
+  long size;
+  const unsigned char* data=(const unsigned char*)files->map(filename.c_str(),size);
+  if(is_compiled(data,size,file.hash))
+  {
+    file.mapped=data;
+    file.mapped_size=size;
+  }
+  else
+  {
+    std::ifstream in(filename.c_str(),std::ios::in|std::ios::binary);
+    if(!in)
+      return 0;
+    std::ostringstream buffer;
+    buffer<<in.rdbuf();
+    std::string bytes=buffer.str();
+    if(!is_compiled((const unsigned char*)bytes.data(),bytes.size(),file.hash))
+      return 0;
+    file.compiled.assign(bytes.begin(),bytes.end());
+  }
+  const unsigned char* p=table(file);
+  file.lang=(const char*)p+read_u32(p+20);
+  file.author=(const char*)p+read_u32(p+24);
+  return 1;
 }
 
-std::string language::read_author(std::string file_name)
+// the .langc of the strings parsed; a later line for an id takes its place
+void language::compile(lang_file& file)
 {
-  std::ifstream file;
-  std::string author;
+  const char* text=file.data ? file.data : file.text.data();
+  long count=0;
+  for(int f=0; f<file.entries.size(); f++)
+    if(file.entries[f].id>=count)
+      count=file.entries[f].id+1;
+  std::vector<int> last(count,-1);
+  for(int f=0; f<file.entries.size(); f++)
+    last[file.entries[f].id]=f;
 
-  std::string filename="lang/"+file_name;
-  file.open(filename.c_str());
-  if(file)
+  std::vector<unsigned char> head;
+  std::vector<unsigned char> body;
+  long at=LANGC_HEADER+count*LANGC_ENTRY;
+  head.insert(head.end(),(const unsigned char*)LANGC_MAGIC,(const unsigned char*)LANGC_MAGIC+4);
+  put_u32(head,LANGC_VERSION);
+  put_u32(head,file.hash);
+  put_u32(head,LANGC_RULE);
+  put_u32(head,count);
+  put_u32(head,at+body.size());
+  body.insert(body.end(),file.lang.begin(),file.lang.end());
+  body.push_back(0);
+  put_u32(head,at+body.size());
+  body.insert(body.end(),file.author.begin(),file.author.end());
+  body.push_back(0);
+  for(long f=0; f<count; f++)
   {
-    char buffer[1024];
-    std::string bfline;
-    std::string code;
-    while(file.getline(buffer,1024))
+    if(last[f]<0)
     {
-      bfline=buffer;
-      int i=bfline.find(" ",1);
-      code=bfline.substr(0,i);
-#ifdef PLATFORM_GP2X
-      author=bfline.substr(i+1,bfline.size()-i-2);
-#endif
-#ifdef PLATFORM_WIN
-      author=bfline.substr(i+1,bfline.size()-i-1);
-#endif
-      if(code.substr(0,1)=="@")
-        if(code.substr(1)=="author")
-          break;
+      put_u32(head,0);
+      put_u32(head,0);
+      continue;
     }
+    lang_entry& e=file.entries[last[f]];
+    put_u32(head,at+body.size());
+    int start=body.size();
+    body.insert(body.end(),text+e.start,text+e.start+e.length);
+    body.push_back(0);
+    put_u32(head,int_format((const char*)&body[start]));
   }
-  file.close();
 
-  return author;
+  file.compiled.swap(head);
+  file.compiled.insert(file.compiled.end(),body.begin(),body.end());
+  std::string().swap(file.text);
+  std::vector<lang_entry>().swap(file.entries);
+  file.data=NULL;
 }
 
-void language::read_languages()
+// the .langc, NULL if it is still to be compiled
+const unsigned char* language::table(lang_file& file)
 {
-  DIR *dp;
-  struct dirent *dirp;
+  if(file.mapped)
+    return file.mapped;
+  return file.compiled.empty() ? NULL : &file.compiled[0];
+}
 
-   if((dp=opendir("./lang")) != NULL)
-   {
-      while ((dirp=readdir(dp)) != NULL)
-      {
-        if(dirp->d_name!=std::string(".") && dirp->d_name!=std::string("..") && std::string(dirp->d_name).substr(std::string(dirp->d_name).size()-5)==".lang")
-        {
-          lang_file tmp;
-          tmp.file=dirp->d_name;
-          //tmp.lang=dirp->d_name;
-          //std::string n=dirp->d_name;
-          tmp.lang=read_name(dirp->d_name);
-          tmp.author=read_author(dirp->d_name);
-          language_list.push_back(tmp);
-        }
-      }
-      closedir(dp);
-   }
+// the languages in lang/, each .lang read once; those without a current
+// .langc are compiled when set
+void language::read_languages(asset_pack& pack)
+{
+  files=&pack;
+  std::vector<std::string> names;
+  files->list("lang",".lang",names);
+  language_list.reserve(names.size());
+  for(int f=0; f<names.size(); f++)
+  {
+    language_list.push_back(lang_file());
+    lang_file& file=language_list.back();
+    file.file=names[f];
+    file.mapped=NULL;
+    file.mapped_size=0;
+    if(!read_file(file))
+    {
+      language_list.pop_back();
+      continue;
+    }
+    if(read_compiled(file))
+    {
+      std::string().swap(file.text);
+      file.data=NULL;
+    }
+    else
+      parse(file);
+  }
+}
+
+// every language compiled and its .langc written, for a pack
+void language::write_compiled()
+{
+  for(int f=0; f<language_list.size(); f++)
+  {
+    lang_file& file=language_list[f];
+    if(!table(file))
+      compile(file);
+    long size=file.mapped ? file.mapped_size : file.compiled.size();
+    write_file("lang/"+file.file+"c",table(file),size);
+  }
 }
 
 int language::languages_count()
@@ -110,53 +336,19 @@ int language::languages_count()
   return language_list.size();
 }
 
+// a language not set before is compiled and its .langc written
 void language::set_language(int id)
 {
-  std::ifstream file;
-
   if(id>=0 && id<language_list.size())
   {
-    std::string filename="lang/"+language_list[id].file;
-    file.open(filename.c_str());
-    if(file)
+    lang_file& file=language_list[id];
+    if(!table(file))
     {
-      id_language=id;
-      string_list.clear();
-
-      char buffer[1024];
-      std::string bfline;
-      std::string code;
-      std::string line;
-      while(file.getline(buffer,1024))
-      {
-        bfline=buffer;
-        int i=bfline.find(" ",1);
-        code=bfline.substr(0,i);
-#ifdef PLATFORM_GP2X
-        line=bfline.substr(i+1,bfline.size()-i-2);
-#endif
-#ifdef PLATFORM_WIN
-        line=bfline.substr(i+1,bfline.size()-i-1);
-#endif
-        if(code.substr(0,1)=="@")
-        {
-          if(code.substr(1)!="lang")
-          {
-            int id=atoi(code.substr(1).c_str());
-            if(id>=string_list.size())
-            {
-              int sz=id+1-string_list.size();
-              for(int f=0; f<sz; f++)
-              {
-                string_list.push_back("");
-              }
-            }
-            string_list[id]=line;
-          }
-        }
-      }
+      compile(file);
+      write_file("lang/"+file.file+"c",table(file),file.compiled.size());
     }
-    file.close();
+    id_language=id;
+    strings=table(file);
   }
 }
 
@@ -169,6 +361,8 @@ char* language::language_name(int id)
 {
   if(id>=0 && id <language_list.size())
     return (char*)language_list[id].lang.c_str();
+  if(id==0 && language_list.empty())
+    return (char*)FALLBACK_LANGUAGE;
   return &nullstring;
 }
 
@@ -179,9 +373,29 @@ char* language::language_author(int id)
   return &nullstring;
 }
 
-char* language::get_string(int id)
+char* language::get_string(string_id id)
 {
-  if(id>=0 && id<string_list.size())
-    return (char*)string_list[id].c_str();
-  return &nullstring;
+  if(id<0 || id>=STRING_COUNT)
+    return &nullstring;
+  if(strings && id<read_u32(strings+16))
+  {
+    long offset=read_u32(strings+LANGC_HEADER+id*LANGC_ENTRY);
+    if(offset)
+      return (char*)strings+offset;
+  }
+  return (char*)fallback_strings[id];
+}
+
+// the string, if it is safe to give printf() with one int
+char* language::get_format(string_id id)
+{
+  if(id<0 || id>=STRING_COUNT)
+    return &nullstring;
+  if(strings && id<read_u32(strings+16))
+  {
+    const unsigned char* entry=strings+LANGC_HEADER+id*LANGC_ENTRY;
+    if(read_u32(entry))
+      return read_u32(entry+4) ? (char*)strings+read_u32(entry) : &nullstring;
+  }
+  return fallback_formats[id] ? (char*)fallback_strings[id] : &nullstring;
 }
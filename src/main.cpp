@@ -9,6 +9,25 @@
 #include <exp_core.h>
 #include <exp_sdl.h>
 #include "../inc/language.h"
+#include "../inc/fixed.h"
+#include "../inc/entity.h"
+#include "../inc/spatial_hash.h"
+#include "../inc/collision_mask.h"
+#include "../inc/stats.h"
+#include "../inc/jobs.h"
+#include "../inc/triple_buffer.h"
+#include "../inc/game_state.h"
+#include "../inc/rewind.h"
+#include "../inc/asset_loader.h"
+#include "../inc/audio_stream.h"
+#include "../inc/sound_mixer.h"
+#include "../inc/asset_pack.h"
+#ifdef EMBED_ASSETS
+#include "../inc/embedded_assets.h"
+#endif
+#include "../inc/sprite_cache.h"
+#include "../inc/exp_rules.h"
+#include "../inc/atomic.h"
 
 ///////////////////////////////////
 /*  Joystick codes               */
@@ -63,61 +82,23 @@
 #define PROGRAM_MODE_PAUSE  3
 #define PROGRAM_MODE_END    4
 
-///////////////////////////////////
-/*  Ship directions              */
-///////////////////////////////////
-#define DIR_DOWN    0
-#define DIR_LEFT    1
-#define DIR_RIGHT   2
-
 ///////////////////////////////////
 /*  Structs                      */
 ///////////////////////////////////
-struct gold_box
-{
-  int x;
-  int y;
-  int exist;
-  int carried;
-};
-
-struct cloud_base
-{
-  int x;
-  int y;
-  float frame;
-  float vel;
-};
-
-struct green_base
-{
-  int x;
-  int y;
-  float frame;
-};
-
-struct bug_base
-{
-  int x;
-  int y;
-  int dir_x;
-  int dir_y;
-};
-
-struct bubble_base
-{
-  int x;
-  int y;
-  float ah;
-  float av;
-};
-
 struct record
 {
   char name[21];
   int score;
 };
 
+// one game of a batch run and what came out of it
+struct batch_game
+{
+  game_state game;
+  std::vector<int> scores;        // games ended with each score
+  std::vector<int> levels;        // games ended at each level
+};
+
 struct joystick_state
 {
   int left;
@@ -140,12 +121,52 @@ struct joystick_state
   int any;
 };
 
+// what drawing needs of one simulation frame
+struct game_snapshot
+{
+  int program_mode;
+  int menu_selection;
+  int language;
+  int level;
+  int score;
+  int ship_disabled;
+  int ship_x;
+  int ship_y;
+  int water_wave;
+  std::vector<int> gold_x;
+  std::vector<int> gold_y;
+  std::vector<int> bug_x;
+  std::vector<int> bug_y;
+  std::vector<int> bubble_x;
+  std::vector<int> bubble_y;
+  std::vector<int> plant_x;
+  std::vector<int> plant_y;
+  std::vector<int> plant_frame;
+  std::vector<int> cloud_x;
+  std::vector<int> cloud_y;
+  std::vector<record> records;
+  int loading;                    // percent of the assets loaded
+};
+
+// a sound the loader fills in
+struct sound_file
+{
+  const char* name;               // without extension
+  int policy;                     // SOUND_DECODE_*
+  Mix_Chunk** chunk;              // on load: the decoded sound
+  audio_stream* stream;           // on play: the stream
+  int priority;                   // on load: for a voice of the mixer
+  int interval;                   // on load: ms before it is started again
+  int asset;                      // loader id, -1 if not loaded at all
+  int channel;                    // on play, without streams: looping the chunk, -1 if not
+};
+
 ///////////////////////////////////
 /*  Globals                      */
 ///////////////////////////////////
 SDL_Surface *screen;   		    // screen to work
 SDL_Surface *screen2;   		    // real screen of game (it will be x2 zoomed)
-int done=0;
+volatile int done=0;
 int program_mode=PROGRAM_MODE_MENU;
 TTF_Font *font;                 // used font
 SDL_Joystick *joystick;         // used joystick
@@ -168,50 +189,238 @@ SDL_Surface *boat;
 SDL_Surface *bubble;
 SDL_Surface *cloud;
 SDL_Surface *green[4];
+// collision masks
+collision_mask ship_mask;
+collision_mask bug_mask;
+collision_mask gold_mask;
 //sonidos
 Mix_Chunk *sound_bubble;
 Mix_Chunk *sound_gold;
 Mix_Chunk *sound_hit;
 Mix_Chunk *sound_roar;
-Mix_Chunk *sound_water;
-Mix_Chunk *sound_engine;
+Mix_Chunk *sound_engine=NULL;     // the loops, when the device takes no streams
+Mix_Chunk *sound_water=NULL;
+// loops, played from their files
+audio_stream water_stream;
+audio_stream engine_stream;
+
+///////////////////////////////////
+/*  Asset variables              */
+///////////////////////////////////
+// Files come out of data.pak when it is there, else from disk; -loose takes
+// those on disk first. The exp notices take their images from the pack; the
+// exp library opens its own copies and its icon from disk.
+// Built with EMBED_ASSETS the pack is the one compiled in, and data.pak is
+// not looked for; what it lacks, and with -loose what is on disk, is read
+// from disk.
+// Sprites are taken ready to draw from SPRITE_CACHE; one whose BMP is not
+// there or has changed is converted and the cache written again.
+// The font and the bubble the menu needs load before the first frame; the
+// other sprites, then the sounds from the smallest up, load behind the
+// menu. Nothing a load function fills in is touched before it is ready.
+// A sound may be an Ogg Vorbis (name.ogg, Wiz build only), an IMA ADPCM or
+// a PCM WAV (name.wav). Short effects are decoded whole when loaded; the
+// long loops are decoded as they play, through the music hook, so only a
+// third of a second of each is resident. Through the music hook, short
+// effects play on the voices of mixer; with any other output format they
+// are SDL_mixer chunks.
+#define SPRITE_CACHE    "data/sprites.cache"
+#define EXP_RULES       "data/exp.rules"
+#define SOUND_DECODE_ON_LOAD  0
+#define SOUND_DECODE_ON_PLAY  1
+#define SOUND_BUBBLE    0
+#define SOUND_GOLD      1
+#define SOUND_HIT       2
+#define SOUND_ROAR      3
+#define SOUND_ENGINE    4
+#define SOUND_WATER     5
+#define SOUND_COUNT     6
+sound_file sound_files[SOUND_COUNT]=
+{
+  {"data/bubble",SOUND_DECODE_ON_LOAD,&sound_bubble,NULL,0,100,-1,-1},
+  {"data/gold",SOUND_DECODE_ON_LOAD,&sound_gold,NULL,2,0,-1,-1},
+  {"data/hit",SOUND_DECODE_ON_LOAD,&sound_hit,NULL,2,0,-1,-1},
+  {"data/roar",SOUND_DECODE_ON_LOAD,&sound_roar,NULL,3,0,-1,-1},
+  {"data/engine",SOUND_DECODE_ON_PLAY,&sound_engine,&engine_stream,0,0,-1,-1},
+  {"data/water",SOUND_DECODE_ON_PLAY,&sound_water,&water_stream,0,0,-1,-1}
+};
+sound_mixer mixer;
+int stream_rate=0;                // mixer output sounds are decoded for,
+int stream_channels=0;            // 0 if it is not 16-bit mono or stereo
+asset_pack pack;                  // data.pak, if there is one
+sprite_cache cooked_sprites;      // SPRITE_CACHE, while the sprites load
+int cook=0;                       // write SPRITE_CACHE and the .langc afresh and quit
+asset_loader assets;
+int sprites_asset=-1;
+int water_playing=0;
+long long start_usec=0;           // when main() began
+long long first_frame_usec=0;     // when the first frame was flipped
+long long menu_ready_usec=0;      // when the menu assets were loaded
+int startup_log=0;                // write startup.log at exit
+
+///////////////////////////////////
+/*  Audio variables              */
+///////////////////////////////////
+// The device is opened as asked and sounds are converted to what it gives
+// at load, so nothing is resampled while mixing. A sound is heard about a
+// buffer after it is played: with -autotune the buffer is halved every few
+// quiet seconds until the callback comes late, then doubled once and kept.
+#define AUDIO_MIN_BUFFER  128       // samples
+#define AUDIO_MAX_BUFFER  4096      // below STREAM_FRAMES, or the loops starve
+#define AUDIO_TUNE_MS     3000      // without underruns before a smaller buffer
+int audio_rate=MIX_DEFAULT_FREQUENCY;
+Uint16 audio_format=AUDIO_S16;
+int audio_channels=MIX_DEFAULT_CHANNELS;
+int audio_buffer=1024;            // samples per callback
+int audio_open=0;
+int audio_autotune=0;             // still tuning
+int audio_log=0;                  // write audio.log at exit
+Uint32 tune_time=0;               // when the buffer last changed
+int tune_underruns=0;             // underruns counted when it changed
+std::vector<int> tune_buffers;    // buffers tried, and the underruns at each
+std::vector<int> tune_results;
+volatile int audio_reopening=0;   // set while reopen_audio() has the device closed
+volatile int audio_playing=0;     // play_sound() calls under way
+volatile int chunk_end=0;         // SDL_GetTicks() when the chunks play_sound() gave SDL_mixer end
+// written by the audio thread
+volatile int audio_callbacks=0;
+volatile int audio_underruns=0;   // callbacks later than half a buffer
+volatile int audio_marked=0;      // set by play_sound(), cleared here
+long long audio_mark=0;           // usec a sound was played at, once marked
+volatile int latency_total=0;     // usec, over latency_count sounds
+volatile int latency_count=0;
+volatile int latency_peak=0;
+volatile int mix_usec_total=0;    // in the music hook, over audio_callbacks
+volatile int mix_usec_peak=0;
+long long callback_last=0;        // usec, 0 before the first callback
 
 ///////////////////////////////////
 /*  Menu variables               */
 ///////////////////////////////////
 int menu_selection=0;
+int start_latched=0;                    // A on start before the sprites loaded
 
 ///////////////////////////////////
 /*  Game variables               */
 ///////////////////////////////////
-int level=0;
-int score=0;
-int ship_disabled=false;
-int ship_x=0;
-int ship_y=0;
-float ship_ah=0;
-float ship_av=0;
-int ship_load=0;
-int engine_on=false;
-float water_wave=0;
-gold_box gold_list[4];
-std::vector<bug_base> bug_list;
-std::vector<bubble_base> bubble_list;
+game_state game;
 std::vector<record> record_list;
-std::vector<green_base> green_list;
-std::vector<cloud_base> cloud_list;
+int autopilot=0;
+
+///////////////////////////////////
+/*  Job variables                */
+///////////////////////////////////
+#define JOB_GRAIN   1024      // entities per parallel_for part
+job_system jobs;
+int job_threads=-1;           // -1: one per extra core
+
+///////////////////////////////////
+/*  Thread variables             */
+///////////////////////////////////
+// The simulation steps on its own thread and publishes a snapshot of every
+// frame; the main thread polls events and draws the newest snapshot. Only
+// the main thread touches video, events, fonts and the exp library.
+#define GAME_FPS    60
+int sim_threaded=-1;                    // -1: only with more than one core
+SDL_Thread *sim_thread=NULL;
+SDL_mutex *input_lock;                  // guards input_events
+joystick_state input_events;            // presses the simulation has not seen
+SDL_mutex *exp_lock;                    // guards exp_queue
+std::vector<int> exp_queue;             // won by the simulation, not yet awarded
+exp_rules exps;                         // fed by the simulation
+int language_selected=0;                // menu choice, applied when drawn
+triple_buffer<game_snapshot> snapshots;
+
+///////////////////////////////////
+/*  Exp notice variables         */
+///////////////////////////////////
+// An exp won is told in a notice that slides down from the top of the
+// screen, stays and slides back up. It is drawn once, icon and texts, and
+// blitted over each frame it shows; the exp library draws nothing itself.
+#define NOTICE_SLIDE_MS   300
+#define NOTICE_SHOW_MS    3000      // the slides included
+#define NOTICE_H          32
+struct exp_notice
+{
+  int id;
+  std::string title;
+  std::string desc;
+};
+std::vector<exp_notice> notices;        // won, waiting to be shown
+SDL_Surface* notice_surface=NULL;       // the notice showing
+Uint32 notice_start=0;
+
+///////////////////////////////////
+/*  Rewind variables             */
+///////////////////////////////////
+// Hold L to play the game backwards, frame by frame. A frame takes some
+// 300 bytes, a keyframe 1 to 2 KB, so 30 seconds fit in well under the
+// budget; with a crowd of bugs the oldest seconds go first. On the end
+// screen L only looks back: the frames are shown, never played on from.
+#define REWIND_SECONDS  30
+#define REWIND_KEYFRAME 60        // frames between whole states
+#define REWIND_BYTES    (1<<20)
+rewind_buffer history(REWIND_BYTES,REWIND_SECONDS*GAME_FPS,REWIND_KEYFRAME);
+std::vector<int> history_state;   // scratch for game.save()
+int review_back=0;                // frames back the end screen shows
+
+///////////////////////////////////
+/*  Presenter variables          */
+///////////////////////////////////
+// With a presenter thread the game draws into one of two buffers while the
+// other is zoomed into screen2 and flipped. A buffer is not drawn into again
+// before it has been shown, so at most one frame waits to be shown.
+int presenter=-1;                       // -1: only with more than one core
+SDL_Thread *present_thread=NULL;
+SDL_mutex *present_lock;                // guards the frame_ variables
+SDL_cond *present_cond;
+SDL_Surface *frame_buffer[2];
+int frame_busy[2]={0,0};                // handed over, not shown yet
+int frame_queued=-1;                    // buffer waiting for the presenter
+int frame_current=0;                    // buffer screen points at
+int present_running=0;
 
 ///////////////////////////////////
-/*  Exp variables                */
+/*  Stress variables             */
 ///////////////////////////////////
-Uint32 floating_time;
-Uint32 floor_time;
+#define STRESS_STEPS    10
+#define STRESS_FRAMES   300
+int stress=0;               // autopilot run reporting frame times
+int stress_bugs=1000;       // bugs at the last step
+int stress_bubbles=2;       // extra bubbles per frame
+int stress_frame=0;
+FILE* stress_log;
+frame_stats stats;          // main thread frames
+frame_stats sim_stats;      // simulation frames
+frame_stats present_stats;  // frames shown
+SDL_mutex *stats_lock;      // the simulation resets stats between steps
+
+///////////////////////////////////
+/*  Soak variables               */
+///////////////////////////////////
+#define SOAK_REPORT     36000     // frames between soak.log lines, 10 minutes of play
+int headless=0;                   // no window, sound or joystick
+int soak=0;                       // autopilot games back to back, no FPS limit
+int soak_frames=1000000;
+FILE* soak_log;
+std::vector<int> soak_scores;     // games ended with each score
+std::vector<int> soak_levels;     // games ended at each level
+
+///////////////////////////////////
+/*  Batch variables              */
+///////////////////////////////////
+int batch=0;                      // games stepped at once, headless like soak
+unsigned int batch_seed=1;        // game i is seeded batch_seed+i
+std::vector<batch_game*> batch_list;
 
 ///////////////////////////////////
 /*  Function declarations        */
 ///////////////////////////////////
-void process_events();
+void take_events();
 void process_joystick();
+void play_events();
+void award_exp(int id);
+void queue_notice(int id, int value, char* title, char* desc);
 
 ///////////////////////////////////
 /*  Functions                    */
@@ -231,6 +440,20 @@ void draw_text(SDL_Surface* dst, char* string, int x, int y, int fR, int fG, int
   }
 }
 
+///////////////////////////////////
+/*  Draw a sprite at positions   */
+///////////////////////////////////
+void draw_sprites(SDL_Surface* sprite, const std::vector<int>& x, const std::vector<int>& y)
+{
+  SDL_Rect dest;
+  for(int i=0; i<x.size(); i++)
+  {
+    dest.x=x[i];
+    dest.y=y[i];
+    SDL_BlitSurface(sprite,NULL,screen,&dest);
+  }
+}
+
 ///////////////////////////////////
 /*  Get pixel from surface       */
 ///////////////////////////////////
@@ -379,26 +602,41 @@ void filter_surface(SDL_Surface *src, SDL_Surface *dst)
   SDL_UnlockSurface(src);
 }
 
-void clear_joystick_state()
-{
-  mainjoystick.left=0;
-  mainjoystick.right=0;
-  mainjoystick.up=0;
-  mainjoystick.down=0;
-  mainjoystick.pad_left=0;
-  mainjoystick.pad_right=0;
-  mainjoystick.pad_up=0;
-  mainjoystick.pad_down=0;
-  mainjoystick.button_a=0;
-  mainjoystick.button_b=0;
-  mainjoystick.button_x=0;
-  mainjoystick.button_y=0;
-  mainjoystick.button_l=0;
-  mainjoystick.button_r=0;
-  mainjoystick.button_back=0;
-  mainjoystick.button_start=0;
-  mainjoystick.escape=0;
-  mainjoystick.any=0;
+///////////////////////////////////
+/*  Build mask from colour key   */
+///////////////////////////////////
+void build_mask(SDL_Surface *src, collision_mask& mask)
+{
+  Uint32 key=SDL_MapRGB(src->format,255,0,255);
+  mask.create(src->w,src->h);
+  SDL_LockSurface(src);
+  for(int g=0; g<src->h; g++)
+    for(int f=0; f<src->w && f<MASK_MAX_WIDTH; f++)
+      if(get_pixel(src,f,g)!=key)
+        mask.set(f,g);
+  SDL_UnlockSurface(src);
+}
+
+void clear_joystick_state(joystick_state& js)
+{
+  js.left=0;
+  js.right=0;
+  js.up=0;
+  js.down=0;
+  js.pad_left=0;
+  js.pad_right=0;
+  js.pad_up=0;
+  js.pad_down=0;
+  js.button_a=0;
+  js.button_b=0;
+  js.button_x=0;
+  js.button_y=0;
+  js.button_l=0;
+  js.button_r=0;
+  js.button_back=0;
+  js.button_start=0;
+  js.escape=0;
+  js.any=0;
 }
 
 void load_records()
@@ -472,10 +710,22 @@ void init_exp()
       exp_add_img(i+1,n);
     }
     exp_add_icon("data/exp.icon.bmp");
+
+    // what wins them
+    SDL_RWops* rules=pack.rw(EXP_RULES);
+    if(rules)
+    {
+      int size=SDL_RWseek(rules,0,RW_SEEK_END);
+      std::vector<char> text(size+1);
+      SDL_RWseek(rules,0,RW_SEEK_SET);
+      size=SDL_RWread(rules,&text[0],1,size);
+      SDL_RWclose(rules);
+      exps.award=award_exp;
+      exps.read(&text[0],size);
+    }
   }
 
-  exp_screen(screen);
-  exp_set_callback(&exp_callback);
+  exp_set_callback(&queue_notice);
 
   // set default language from profile
   lang.set_language(0);
@@ -489,140 +739,430 @@ void init_exp()
       break;
     }
   }
+  language_selected=lang.language_id();
 }
 
-void init_game()
+///////////////////////////////////
+/*  Load assets                  */
+///////////////////////////////////
+// hash of a file's bytes, 0 if it is nowhere; the last one is kept, as
+// the slices of a strip ask in turn
+unsigned int file_hash(const char* file)
 {
-  srand(time(NULL));
-  joystick=SDL_JoystickOpen(0);
-  SDL_ShowCursor(0);
+  static std::string last_file;
+  static unsigned int last_hash=0;
+  if(last_file==file)
+    return last_hash;
+
+  unsigned int hash=0;
+  long size;
+  const void* packed=pack.map(file,size);
+  if(packed)
+    hash=fnv_hash(packed,size);
+  else
+  {
+    FILE* f=fopen(file,"rb");
+    if(f)
+    {
+      std::vector<unsigned char> bytes;
+      fseek(f,0,SEEK_END);
+      bytes.resize(ftell(f)+1);
+      fseek(f,0,SEEK_SET);
+      size=fread(&bytes[0],1,bytes.size(),f);
+      fclose(f);
+      hash=fnv_hash(&bytes[0],size);
+    }
+  }
+  last_file=file;
+  last_hash=hash;
+  return hash;
+}
 
-  Mix_OpenAudio(MIX_DEFAULT_FREQUENCY, AUDIO_S16, MIX_DEFAULT_CHANNELS, 1024);
+// 16-bit colour keyed copy of a BMP, or of the slice_w wide slice number
+// slice of it, NULL if it does not load; the mask, if any, gets its opaque
+// pixels
+SDL_Surface* load_sprite(const char* file, int slice, int slice_w, collision_mask* mask)
+{
+  unsigned int hash=file_hash(file);
+  SDL_Surface *sprite=cooked_sprites.get(file,slice,hash,mask);
+  if(sprite)
+    return sprite;
+
+  SDL_Surface *tmpsurface=SDL_LoadBMP_RW(pack.rw(file),1);
+  if(!tmpsurface)
+    return NULL;
+  SDL_Rect rect;
+  rect.x=slice*slice_w;
+  rect.y=0;
+  rect.w=slice_w>0 ? slice_w : tmpsurface->w;
+  rect.h=tmpsurface->h;
+  sprite=SDL_CreateRGBSurface(SDL_SRCCOLORKEY, rect.w, rect.h, 16, 0,0,0,0);
+  if(sprite)
+  {
+    SDL_BlitSurface(tmpsurface,&rect,sprite,NULL);
+    SDL_SetColorKey(sprite,SDL_SRCCOLORKEY,SDL_MapRGB(screen->format,255,0,255));
+  }
+  if(mask)
+    build_mask(tmpsurface,*mask);
+  SDL_FreeSurface(tmpsurface);
+  cooked_sprites.add(file,slice,hash,sprite,mask);
+  return sprite;
+}
 
-  TTF_Init();
-  font=TTF_OpenFont("data/pixantiqua.ttf", 12);
+// loader thread: everything a game needs on screen
+void load_sprites(void* data)
+{
+  ship=load_sprite("data/ship.bmp",0,0,&ship_mask);
+  shipdisabled=load_sprite("data/shipdisabled.bmp",0,0,NULL);
+  bug=load_sprite("data/bug.bmp",0,0,&bug_mask);
+  gold=load_sprite("data/gold.bmp",0,0,&gold_mask);
+  boat=load_sprite("data/boat.bmp",0,0,NULL);
+  cloud=load_sprite("data/cloud.bmp",0,0,NULL);
+  for(int f=0; f<4; f++)
+    green[f]=load_sprite("data/green.bmp",f,8,NULL);
 
-  SDL_Rect rect;
-  SDL_Surface *tmpsurface;
+  // the bubble was loaded first, every sprite is in
+  if(cooked_sprites.misses>0 || cook)
+    cooked_sprites.write(SPRITE_CACHE,screen->format);
+  cooked_sprites.close();
+}
 
-  tmpsurface=SDL_LoadBMP("data/ship.bmp");
-  if(tmpsurface)
+// name.ogg if this build plays it and it is there, else name.wav
+std::string sound_path(const char* name)
+{
+#ifdef USE_TREMOR
+  std::string ogg=std::string(name)+".ogg";
+  if(pack.exists(ogg.c_str()))
+    return ogg;
+#endif
+  return std::string(name)+".wav";
+}
+
+// loader thread: one sound_file, decoded whole or opened and read up to
+// its first frames; a loop is a chunk too if the device takes no streams
+void load_sound(void* data)
+{
+  sound_file* sound=(sound_file*)data;
+  std::string path=sound_path(sound->name);
+  long size;
+  const void* packed=pack.map(path.c_str(),size);
+  if(sound->policy==SOUND_DECODE_ON_PLAY && stream_channels)
   {
-    ship=SDL_CreateRGBSurface(SDL_SRCCOLORKEY, tmpsurface->w, tmpsurface->h, 16, 0,0,0,0);
-    rect.x=0;
-    rect.y=0;
-    rect.w=tmpsurface->w;
-    rect.h=tmpsurface->h;
-    SDL_BlitSurface(tmpsurface,&rect,ship,NULL);
-    SDL_SetColorKey(ship,SDL_SRCCOLORKEY,SDL_MapRGB(screen->format,255,0,255));
-    SDL_FreeSurface(tmpsurface);
+    if(packed ? sound->stream->open(packed,size,stream_rate,stream_channels,1) : sound->stream->open(path.c_str(),stream_rate,stream_channels,1))
+      sound->stream->fill();
+    return;
   }
 
-  tmpsurface=SDL_LoadBMP("data/shipdisabled.bmp");
-  if(tmpsurface)
+  // SDL_mixer reads PCM WAVs itself, for any output format
+  audio_stream decode;
+  std::vector<short> pcm;
+  if(stream_channels && (packed ? decode.open(packed,size,stream_rate,stream_channels,0) : decode.open(path.c_str(),stream_rate,stream_channels,0)))
   {
-    shipdisabled=SDL_CreateRGBSurface(SDL_SRCCOLORKEY, tmpsurface->w, tmpsurface->h, 16, 0,0,0,0);
-    rect.x=0;
-    rect.y=0;
-    rect.w=tmpsurface->w;
-    rect.h=tmpsurface->h;
-    SDL_BlitSurface(tmpsurface,&rect,shipdisabled,NULL);
-    SDL_SetColorKey(shipdisabled,SDL_SRCCOLORKEY,SDL_MapRGB(screen->format,255,0,255));
-    SDL_FreeSurface(tmpsurface);
+    if(decode.decode_all(pcm))
+      mixer.set(sound-sound_files,pcm,sound->priority,sound->interval*stream_rate/1000);
   }
+  else
+    *sound->chunk=Mix_LoadWAV_RW(pack.rw(path.c_str()),1);
+}
+
+// a loop from its stream, else from its chunk on a channel of its own
+void play_loop(int id)
+{
+  sound_file& s=sound_files[id];
+  if(stream_channels)
+    s.stream->play();
+  else if(s.channel<0 && *s.chunk)
+    s.channel=Mix_PlayChannel(-1,*s.chunk,-1);
+}
 
-  tmpsurface=SDL_LoadBMP("data/bug.bmp");
-  if(tmpsurface)
+// no channel is touched while the device is being reopened, as in play_sound()
+void stop_loop(int id)
+{
+  sound_file& s=sound_files[id];
+  if(stream_channels)
   {
-    bug=SDL_CreateRGBSurface(SDL_SRCCOLORKEY, tmpsurface->w, tmpsurface->h, 16, 0,0,0,0);
-    rect.x=0;
-    rect.y=0;
-    rect.w=tmpsurface->w;
-    rect.h=tmpsurface->h;
-    SDL_BlitSurface(tmpsurface,&rect,bug,NULL);
-    SDL_SetColorKey(bug,SDL_SRCCOLORKEY,SDL_MapRGB(screen->format,255,0,255));
-    SDL_FreeSurface(tmpsurface);
+    s.stream->stop();
+    return;
   }
-  tmpsurface=SDL_LoadBMP("data/gold.bmp");
-  if(tmpsurface)
+  atomic_add(&audio_playing,1);
+  if(s.channel>=0 && !atomic_get(&audio_reopening))
   {
-    gold=SDL_CreateRGBSurface(SDL_SRCCOLORKEY, tmpsurface->w, tmpsurface->h, 16, 0,0,0,0);
-    rect.x=0;
-    rect.y=0;
-    rect.w=tmpsurface->w;
-    rect.h=tmpsurface->h;
-    SDL_BlitSurface(tmpsurface,&rect,gold,NULL);
-    SDL_SetColorKey(gold,SDL_SRCCOLORKEY,SDL_MapRGB(screen->format,255,0,255));
-    SDL_FreeSurface(tmpsurface);
+    Mix_HaltChannel(s.channel);
+    s.channel=-1;
   }
-  tmpsurface=SDL_LoadBMP("data/boat.bmp");
-  if(tmpsurface)
+  atomic_add(&audio_playing,-1);
+}
+
+// a sound that has not loaded yet is not heard, nor one played while the
+// device is being reopened; the caller never waits for the audio thread
+void play_sound(int channel, int id, int loops)
+{
+  atomic_add(&audio_playing,1);
+  if(assets.ready(sound_files[id].asset) && !atomic_get(&audio_reopening))
+  {
+    if(sound_files[id].policy==SOUND_DECODE_ON_PLAY)
+      play_loop(id);
+    else if(mixer.loaded(id))
+      mixer.play(id,MIX_MAX_VOLUME,loops);
+    else
+    {
+      Mix_Chunk* chunk=*sound_files[id].chunk;
+      int bytes=(audio_format&0xff)/8*audio_channels;
+      Uint32 ms=loops<0 ? 0x40000000 : chunk->alen*1000LL*(loops+1)/(audio_rate*bytes);
+      if(Mix_PlayChannel(channel,chunk,loops)>=0 && (int)(SDL_GetTicks()+ms-atomic_get(&chunk_end))>0)
+        atomic_set(&chunk_end,SDL_GetTicks()+ms);
+    }
+    if(!atomic_get(&audio_marked))
+    {
+      audio_mark=stats_usec();
+      atomic_set(&audio_marked,1);
+    }
+  }
+  atomic_add(&audio_playing,-1);
+}
+
+// main thread, every frame: read the streams ahead of the mixer
+void fill_streams()
+{
+  for(int f=0; f<SOUND_COUNT; f++)
+    if(sound_files[f].policy==SOUND_DECODE_ON_PLAY && assets.ready(sound_files[f].asset))
+      sound_files[f].stream->fill();
+}
+
+// audio thread: the loops and the effects, under SDL_mixer's channels
+void mix_streams(void* data, Uint8* stream, int len)
+{
+  long long start=stats_usec();
+  int frames=len/(2*stream_channels);
+  water_stream.mix((short*)stream,frames,MIX_MAX_VOLUME);
+  engine_stream.mix((short*)stream,frames,MIX_MAX_VOLUME);
+  mixer.mix((short*)stream,frames);
+  int usec=(int)(stats_usec()-start);
+  mix_usec_total+=usec;
+  if(usec>mix_usec_peak)
+    mix_usec_peak=usec;
+}
+
+// audio thread, after each buffer is mixed: a callback that comes more
+// than half a buffer late left the device without samples meanwhile; a
+// sound played since the last one is heard once this buffer has played
+void audio_postmix(void* data, Uint8* stream, int len)
+{
+  long long now=stats_usec();
+  int period=(int)(audio_buffer*1000000LL/stream_rate);
+  if(callback_last && (int)(now-callback_last)>period*3/2)
+    atomic_set(&audio_underruns,audio_underruns+1);
+  callback_last=now;
+  atomic_set(&audio_callbacks,audio_callbacks+1);
+
+  if(atomic_get(&audio_marked))
   {
-    boat=SDL_CreateRGBSurface(SDL_SRCCOLORKEY, tmpsurface->w, tmpsurface->h, 16, 0,0,0,0);
-    rect.x=0;
-    rect.y=0;
-    rect.w=tmpsurface->w;
-    rect.h=tmpsurface->h;
-    SDL_BlitSurface(tmpsurface,&rect,boat,NULL);
-    SDL_SetColorKey(boat,SDL_SRCCOLORKEY,SDL_MapRGB(screen->format,255,0,255));
-    SDL_FreeSurface(tmpsurface);
+    int latency=(int)(now-audio_mark)+period;
+    atomic_set(&audio_marked,0);
+    latency_total+=latency;
+    latency_count++;
+    if(latency>latency_peak)
+      latency_peak=latency;
   }
-  tmpsurface=SDL_LoadBMP("data/bubble.bmp");
-  if(tmpsurface)
+}
+
+// the device as configured; 0 if it gives another format than the one
+// the loaded sounds were converted to
+int open_audio()
+{
+  int rate=stream_rate;
+  int channels=stream_channels;
+  if(Mix_OpenAudio(audio_rate,audio_format,audio_channels,audio_buffer)<0)
+    return 0;
+  audio_open=1;
+  callback_last=0;
+  Uint16 format;
+  if(Mix_QuerySpec(&stream_rate,&format,&stream_channels) && format==AUDIO_S16SYS && stream_channels<=2)
   {
-    bubble=SDL_CreateRGBSurface(SDL_SRCCOLORKEY, tmpsurface->w, tmpsurface->h, 16, 0,0,0,0);
-    rect.x=0;
-    rect.y=0;
-    rect.w=tmpsurface->w;
-    rect.h=tmpsurface->h;
-    SDL_BlitSurface(tmpsurface,&rect,bubble,NULL);
-    SDL_SetColorKey(bubble,SDL_SRCCOLORKEY,SDL_MapRGB(screen->format,255,0,255));
-    SDL_FreeSurface(tmpsurface);
+    mixer.open(stream_channels);
+    Mix_HookMusic(mix_streams,NULL);
   }
-  tmpsurface=SDL_LoadBMP("data/cloud.bmp");
-  if(tmpsurface)
+  else
+    stream_channels=0;
+  Mix_SetPostMix(audio_postmix,NULL);
+  return rate==0 || (rate==stream_rate && channels==stream_channels);
+}
+
+void close_audio()
+{
+  if(!audio_open)
+    return;
+  Mix_HaltChannel(-1);
+  Mix_HookMusic(NULL,NULL);
+  Mix_SetPostMix(NULL,NULL);
+  Mix_CloseAudio();
+  mixer.stop_all();
+  audio_open=0;
+}
+
+// the device again with another buffer; the old one back if it will not.
+// A sound the simulation plays meanwhile is skipped; one it is playing
+// already is let finish first
+int reopen_audio(int buffer)
+{
+  atomic_set(&audio_reopening,1);
+  while(atomic_get(&audio_playing))
+    SDL_Delay(0);
+  int old=audio_buffer;
+  close_audio();
+  audio_buffer=buffer;
+  int opened=open_audio();
+  if(!opened)
   {
-    cloud=SDL_CreateRGBSurface(SDL_SRCCOLORKEY, tmpsurface->w, tmpsurface->h, 16, 0,0,0,0);
-    rect.x=0;
-    rect.y=0;
-    rect.w=tmpsurface->w;
-    rect.h=tmpsurface->h;
-    SDL_BlitSurface(tmpsurface,&rect,cloud,NULL);
-    SDL_SetColorKey(cloud,SDL_SRCCOLORKEY,SDL_MapRGB(screen->format,255,0,255));
-    SDL_FreeSurface(tmpsurface);
+    close_audio();
+    audio_buffer=old;
+    open_audio();
   }
-  tmpsurface=SDL_LoadBMP("data/green.bmp");
-  if(tmpsurface)
+  // the loops SDL_mixer played were halted with the device
+  for(int f=0; f<SOUND_COUNT; f++)
+    if(sound_files[f].channel>=0)
+    {
+      sound_files[f].channel=-1;
+      play_loop(f);
+    }
+  atomic_set(&audio_reopening,0);
+  return opened;
+}
+
+// nothing a reopen would cut: no voice in the mixer, no chunk SDL_mixer is
+// still playing and no stream but the sea, which never stops; a stream
+// keeps its ring, so the sea only pauses
+int audio_quiet()
+{
+  if(mixer.voices()>0 || (int)(atomic_get(&chunk_end)-SDL_GetTicks())>0)
+    return 0;
+  for(int f=0; f<SOUND_COUNT; f++)
+    if(f!=SOUND_WATER && sound_files[f].policy==SOUND_DECODE_ON_PLAY && (sound_files[f].stream->is_playing() || sound_files[f].channel>=0))
+      return 0;
+  return 1;
+}
+
+// main thread, every frame: the next buffer size when the last has played
+// long enough without underruns, or back one when it had them. The device
+// is reopened between sounds, and only once they have all been converted
+// to its format
+void tune_audio()
+{
+  if(!audio_autotune || !audio_open || assets.loaded()<assets.count())
+    return;
+  Uint32 now=SDL_GetTicks();
+  int underruns=atomic_get(&audio_underruns);
+  if(underruns>tune_underruns)
   {
-    for(int f=0; f<4; f++)
+    tune_results.back()=underruns-tune_underruns;
+    audio_autotune=0;
+    if(audio_buffer<AUDIO_MAX_BUFFER)
     {
-      rect.x=f*8;
-      rect.y=0;
-      rect.w=8;
-      rect.h=16;
-      green[f]=SDL_CreateRGBSurface(SDL_SRCCOLORKEY, 8, 16, 16, 0,0,0,0);
-      if(green[f])
-      {
-        SDL_BlitSurface(tmpsurface,&rect,green[f],NULL);
-        SDL_SetColorKey(green[f],SDL_SRCCOLORKEY,SDL_MapRGB(screen->format,255,0,255));
-      }
+      reopen_audio(audio_buffer*2);
+      tune_buffers.push_back(audio_buffer);
+      tune_results.push_back(0);
     }
-    SDL_FreeSurface(tmpsurface);
+    tune_underruns=atomic_get(&audio_underruns);
+    return;
+  }
+  if(now-tune_time<AUDIO_TUNE_MS || !audio_quiet())
+    return;
+  if(audio_buffer/2<AUDIO_MIN_BUFFER || !reopen_audio(audio_buffer/2))
+  {
+    audio_autotune=0;
+    return;
   }
+  tune_buffers.push_back(audio_buffer);
+  tune_results.push_back(0);
+  tune_time=now;
+  tune_underruns=atomic_get(&audio_underruns);
+}
+
+void write_audio_log()
+{
+  FILE* log=fopen("audio.log","w");
+  if(!log)
+    return;
+  fprintf(log,"asked\t%i Hz, %i-bit, %i channels\n",audio_rate,audio_format&0xff,audio_channels);
+  fprintf(log,"device\t%i Hz, %i channels, %i sample buffer, %i ms\n",stream_rate,stream_channels,audio_buffer,
+          stream_rate>0 ? audio_buffer*1000/stream_rate : 0);
+  fprintf(log,"callbacks\t%i\n",audio_callbacks);
+  fprintf(log,"underruns\t%i\n",audio_underruns);
+  fprintf(log,"stream starved\t%i\n",water_stream.starved_count()+engine_stream.starved_count());
+  fprintf(log,"latency\t%i ms average, %i ms at most, %i sounds\n",
+          latency_count>0 ? latency_total/latency_count/1000 : 0,latency_peak/1000,latency_count);
+  fprintf(log,"mix\t%i usec average, %i usec at most per callback\n",
+          audio_callbacks>0 ? mix_usec_total/audio_callbacks : 0,mix_usec_peak);
+  fprintf(log,"voices\t%i at most of %i\n",mixer.voices_peak,MIXER_VOICES);
+  fprintf(log,"plays\t%i, %i coalesced, %i stole a voice, %i dropped, %i lost queued\n",
+          mixer.plays,mixer.coalesced,mixer.stolen,mixer.dropped,mixer.lost);
+  if(tune_buffers.size()>0)
+    fprintf(log,"\nbuffer\tunderruns\n");
+  for(int f=0; f<tune_buffers.size(); f++)
+    fprintf(log,"%i\t%i\n",tune_buffers[f],tune_results[f]);
+  fclose(log);
+}
 
-  sound_bubble=Mix_LoadWAV("data/bubble.wav");
-  sound_gold=Mix_LoadWAV("data/gold.wav");
-  sound_hit=Mix_LoadWAV("data/hit.wav");
-  sound_roar=Mix_LoadWAV("data/roar.wav");
-  sound_water=Mix_LoadWAV("data/water.wav");
-  sound_engine=Mix_LoadWAV("data/engine.wav");
+void write_startup_log()
+{
+  FILE* log=fopen("startup.log","w");
+  if(!log)
+    return;
+  fprintf(log,"menu assets\t%i ms\n",(int)(menu_ready_usec/1000));
+  fprintf(log,"first frame\t%i ms\n",(int)(first_frame_usec/1000));
+  fprintf(log,"sprites\t+%i ms\n",assets.usec(sprites_asset)/1000);
+  for(int f=0; f<SOUND_COUNT; f++)
+    fprintf(log,"%s\t+%i ms\n",sound_files[f].name,assets.usec(sound_files[f].asset)/1000);
+  fclose(log);
+}
 
-  Mix_PlayChannel(-1,sound_water,-1);
+void init_game()
+{
+  game.seed(time(NULL));
+  if(!headless)
+  {
+    joystick=SDL_JoystickOpen(0);
+    SDL_ShowCursor(0);
+    open_audio();
+    if(audio_autotune)
+    {
+      tune_time=SDL_GetTicks();
+      tune_buffers.push_back(audio_buffer);
+      tune_results.push_back(0);
+    }
+  }
+
+  TTF_Init();
+  SDL_RWops* font_file=pack.rw("data/pixantiqua.ttf");
+  if(font_file)
+    font=TTF_OpenFontRW(font_file,1,12);
+  // cooking starts from the BMPs alone
+  long cache_size;
+  const void* cache=pack.map(SPRITE_CACHE,cache_size);
+  if(cache && !cook)
+    cooked_sprites.open(cache,cache_size,screen->format);
+  else if(!cook)
+    cooked_sprites.open(SPRITE_CACHE,screen->format);
+  bubble=load_sprite("data/bubble.bmp",0,0,NULL);
+  game.ship_mask=&ship_mask;
+  game.bug_mask=&bug_mask;
+  game.gold_mask=&gold_mask;
+  menu_ready_usec=stats_usec()-start_usec;
+
+  sprites_asset=assets.add(load_sprites,NULL);
+  if(!headless)
+  {
+    for(int f=0; f<SOUND_COUNT; f++)
+      sound_files[f].asset=assets.add(load_sound,&sound_files[f]);
+  }
+  // runs that start playing at once have nothing to show meanwhile
+  assets.start(!headless && !stress);
 }
 
 void end_game()
 {
 	SDL_FillRect(screen, NULL, 0x000000);
+  assets.wait();
 
   if(SDL_JoystickOpened(0))
     SDL_JoystickClose(joystick);
@@ -630,7 +1170,7 @@ void end_game()
   if(ship)
     SDL_FreeSurface(ship);
   if(shipdisabled)
-    SDL_FreeSurface(ship);
+    SDL_FreeSurface(shipdisabled);
   if(bug)
     SDL_FreeSurface(bug);
   if(gold)
@@ -644,122 +1184,18 @@ void end_game()
   for(int f=0; f<4; f++)
     if(green[f])
       SDL_FreeSurface(green[f]);
+  if(notice_surface)
+    SDL_FreeSurface(notice_surface);
 
-  Mix_HaltChannel(-1);
+  close_audio();
   Mix_FreeChunk(sound_bubble);
   Mix_FreeChunk(sound_gold);
   Mix_FreeChunk(sound_hit);
   Mix_FreeChunk(sound_roar);
-  Mix_FreeChunk(sound_water);
   Mix_FreeChunk(sound_engine);
-  Mix_CloseAudio();
-}
-
-void new_bubble(int x, int y, int dir)
-{
-  bubble_base b;
-  b.x=x-4+rand()%9;
-  b.y=y-4+rand()%9;
-  switch(dir)
-  {
-    case DIR_DOWN:
-      b.av=rand()%5;
-      b.ah=rand()%2;
-      break;
-    case DIR_LEFT:
-      b.av=rand()%2;
-      b.ah=-rand()%5;
-      break;
-    case DIR_RIGHT:
-      b.av=rand()%2;
-      b.ah=rand()%5;
-      break;
-  }
-
-  bubble_list.push_back(b);
-  if(rand()%6==0)
-    Mix_PlayChannel(-1,sound_bubble,0);
-}
-
-void new_bug()
-{
-  bug_base b;
-  b.x=rand()%298;
-  b.y=72+rand()%132;
-  b.dir_x=0;
-  b.dir_y=0;
-  while(b.dir_x==0 && b.dir_y==0)
-  {
-    b.dir_x=-1+rand()%3;
-    b.dir_y=-1+rand()%3;
-  }
-  if(b.x>130 && b.x<190 && b.y<100 && b.dir_y<0)
-    b.dir_y=-b.dir_y;
-
-  bug_list.push_back(b);
-}
-
-void new_level()
-{
-  // create treasures
-  for(int i=0; i<4; i++)
-  {
-    gold_list[i].x=28+80*i;
-    gold_list[i].y=228;
-    gold_list[i].exist=1;
-    gold_list[i].carried=0;
-  }
-  // add a new bug
-  new_bug();
-  // inc level
-  level++;
-}
-
-void reset()
-{
-  level=0;
-  score=0;
-  ship_x=148;
-  ship_y=48;
-  ship_ah=0;
-  ship_av=0;
-  ship_load=0;
-
-  bug_list.clear();
-  new_bug();
-  new_bug();
-  bubble_list.clear();
-  green_list.clear();
-  cloud_list.clear();
-
-  floating_time=SDL_GetTicks();
-  floor_time=SDL_GetTicks();
-
-  // plants
-  for(int f=0;;)
-  {
-    green_base g;
-    g.y=212;
-    g.x=f;
-    f+=6+rand()%8;
-    g.frame=rand()%4;
-    green_list.push_back(g);
-    if(f>312)
-      break;
-  }
-  // clouds
-  for(int f=0;f<5;f++)
-  {
-    cloud_base c;
-    c.y=-16+rand()%16;
-    c.x=rand()%320;
-    if(rand()%2==0)
-      c.frame=1;
-    else
-      c.frame=-1;
-    c.vel=0.1+float(rand()%10)/10;
-    cloud_list.push_back(c);
-  }
+  Mix_FreeChunk(sound_water);
+  water_stream.close();
+  engine_stream.close();
 }
 
 void check_score()
@@ -769,11 +1205,11 @@ void check_score()
     sprintf(r.name,exp_user());
   else
     sprintf(r.name,"player");
-  r.score=score;
+  r.score=game.score;
 
   int i;
   for(i=0; i<record_list.size(); i++)
-    if(record_list[i].score<=score)
+    if(record_list[i].score<=game.score)
       break;
 
   if(i>=record_list.size() && record_list.size()<5)
@@ -786,19 +1222,111 @@ void check_score()
   }
 }
 
+// test runs must not touch the player profile; the main thread awards it
+void award_exp(int id)
+{
+  if(stress || soak)
+    return;
+  SDL_mutexP(exp_lock);
+  exp_queue.push_back(id);
+  SDL_mutexV(exp_lock);
+}
+
+// main thread: hand the exps won to the exp library
+void flush_exp()
+{
+  SDL_mutexP(exp_lock);
+  for(int f=0; f<exp_queue.size(); f++)
+    exp_win(exp_queue[f]);
+  exp_queue.clear();
+  SDL_mutexV(exp_lock);
+}
+
+// exp library callback, from exp_win() on the main thread
+void queue_notice(int id, int value, char* title, char* desc)
+{
+  exp_notice n;
+  n.id=id;
+  n.title=title ? title : "";
+  n.desc=desc ? desc : "";
+  notices.push_back(n);
+}
+
+// a notice as it shows: the exp's icon, its title and what won it
+SDL_Surface* make_notice(const exp_notice& n)
+{
+  SDL_PixelFormat* f=screen->format;
+  SDL_Surface* notice=SDL_CreateRGBSurface(SDL_SWSURFACE,screen->w,NOTICE_H,f->BitsPerPixel,f->Rmask,f->Gmask,f->Bmask,0);
+  if(!notice)
+    return NULL;
+  SDL_FillRect(notice,NULL,SDL_MapRGB(notice->format,0,0,64));
+  SDL_Rect edge={0,NOTICE_H-1,(Uint16)notice->w,1};
+  SDL_FillRect(notice,&edge,SDL_MapRGB(notice->format,255,255,255));
+
+  char file[32];
+  sprintf(file,"data/exp%02i.bmp",n.id);
+  SDL_Surface* icon=SDL_LoadBMP_RW(pack.rw(file),1);
+  if(icon)
+  {
+    SDL_Rect at={4,4,0,0};
+    SDL_SetColorKey(icon,SDL_SRCCOLORKEY,SDL_MapRGB(icon->format,255,0,255));
+    SDL_BlitSurface(icon,NULL,notice,&at);
+    SDL_FreeSurface(icon);
+  }
+  draw_text(notice,(char*)n.title.c_str(),32,1,255,255,0);
+  draw_text(notice,(char*)n.desc.c_str(),32,15,255,255,255);
+  return notice;
+}
+
+// the notice showing over the frame, the next one made when it is done
+void draw_notice()
+{
+  if(!notice_surface)
+  {
+    if(notices.empty())
+      return;
+    notice_surface=make_notice(notices[0]);
+    notices.erase(notices.begin());
+    notice_start=SDL_GetTicks();
+    if(!notice_surface)
+      return;
+  }
+  Uint32 t=SDL_GetTicks()-notice_start;
+  if(t>=NOTICE_SHOW_MS)
+  {
+    SDL_FreeSurface(notice_surface);
+    notice_surface=NULL;
+    return;
+  }
+  int shown=t<NOTICE_SLIDE_MS ? t : t>NOTICE_SHOW_MS-NOTICE_SLIDE_MS ? NOTICE_SHOW_MS-t : NOTICE_SLIDE_MS;
+  SDL_Rect at={0,(Sint16)(shown*NOTICE_H/NOTICE_SLIDE_MS-NOTICE_H),0,0};
+  SDL_BlitSurface(notice_surface,NULL,screen,&at);
+}
+
 void finish()
 {
-  check_score();
-  Mix_HaltChannel(4);
-  Mix_PlayChannel(-1,sound_roar,0);
-  if(score==0)
-    exp_win(5);
+  if(!soak)
+    check_score();
+  review_back=0;
   program_mode=PROGRAM_MODE_END;
 }
 
+void start_game()
+{
+  start_latched=0;
+  game.reset();
+  game.new_level();
+  exps.start(game.depth);
+  game.ship_disabled=true;
+  history.clear();
+  program_mode=PROGRAM_MODE_GAME;
+}
+
+// A on start while the sprites load is kept, and the game starts once
+// they are ready; moving off start forgets it
 void read_menu_keys()
 {
-  process_events();
+  take_events();
 
   if(mainjoystick.pad_up)
     if(menu_selection>0)
@@ -806,32 +1334,32 @@ void read_menu_keys()
   if(mainjoystick.pad_down)
     if(menu_selection<2)
         menu_selection++;
+  if(menu_selection!=0)
+    start_latched=0;
   if(mainjoystick.button_a)
     switch(menu_selection)
     {
       case 0:
-        reset();
-        new_level();
-        ship_disabled=true;
-        program_mode=PROGRAM_MODE_GAME;
+        start_latched=1;
         break;
       case 1:
-        int lid=lang.language_id()+1;
-        if(lid>lang.languages_count()-1)
-          lid=0;
-        lang.set_language(lid);
+        language_selected++;
+        if(language_selected>lang.languages_count()-1)
+          language_selected=0;
         break;
       case 2:
         done=1;
         break;
     }
+  if(start_latched && assets.ready(sprites_asset))
+    start_game();
 }
 
-void process_events()
+void process_events(joystick_state& js)
 {
   SDL_Event event;
 
-  clear_joystick_state();
+  clear_joystick_state(js);
   while(SDL_PollEvent(&event))
   {
     switch(event.type)
@@ -841,37 +1369,37 @@ void process_events()
         switch (event.jbutton.button)
         {
           case GP2X_BUTTON_LEFT:
-            mainjoystick.pad_left=1;
+            js.pad_left=1;
             break;
           case GP2X_BUTTON_RIGHT:
-            mainjoystick.pad_right=1;
+            js.pad_right=1;
             break;
           case GP2X_BUTTON_UP:
-            mainjoystick.pad_up=1;
+            js.pad_up=1;
             break;
           case GP2X_BUTTON_DOWN:
-            mainjoystick.pad_down=1;
+            js.pad_down=1;
             break;
           case GP2X_BUTTON_Y:
-            mainjoystick.button_y=1;
+            js.button_y=1;
             break;
           case GP2X_BUTTON_X:
-            mainjoystick.button_a=1;
+            js.button_a=1;
             break;
           case GP2X_BUTTON_B:
-            mainjoystick.button_b=1;
+            js.button_b=1;
             break;
           case GP2X_BUTTON_A:
-            mainjoystick.button_x=1;
+            js.button_x=1;
             break;
           case GP2X_BUTTON_START:
-            mainjoystick.button_start=1;
+            js.button_start=1;
             break;
           case GP2X_BUTTON_SELECT:
-            mainjoystick.button_back=1;
+            js.button_back=1;
             break;
         }
-        mainjoystick.any=1;
+        js.any=1;
         break;
 #endif // PLATFORM_GP2X
 #ifdef PLATFORM_WIN
@@ -879,59 +1407,59 @@ void process_events()
         switch(event.key.keysym.sym)
         {
           case SDLK_LEFT:
-            mainjoystick.pad_left=1;
+            js.pad_left=1;
             break;
           case SDLK_RIGHT:
-            mainjoystick.pad_right=1;
+            js.pad_right=1;
             break;
           case SDLK_UP:
-            mainjoystick.pad_up=1;
+            js.pad_up=1;
             break;
           case SDLK_DOWN:
-            mainjoystick.pad_down=1;
+            js.pad_down=1;
             break;
           case SDLK_a:
-            mainjoystick.button_x=1;
+            js.button_x=1;
             break;
           case SDLK_s:
-            mainjoystick.button_y=1;
+            js.button_y=1;
             break;
           case SDLK_RETURN:
           case SDLK_z:
-            mainjoystick.button_a=1;
+            js.button_a=1;
             break;
           case SDLK_x:
-            mainjoystick.button_b=1;
+            js.button_b=1;
             break;
           case SDLK_ESCAPE:
-            mainjoystick.escape=1;
+            js.escape=1;
             break;
         }
-        mainjoystick.any=1;
+        js.any=1;
         break;
       case SDL_JOYBUTTONDOWN:
         switch (event.jbutton.button)
         {
           case PC_BUTTON_X:
-            mainjoystick.button_x=1;
+            js.button_x=1;
             break;
           case PC_BUTTON_Y:
-            mainjoystick.button_y=1;
+            js.button_y=1;
             break;
           case PC_BUTTON_A:
-            mainjoystick.button_a=1;
+            js.button_a=1;
             break;
           case PC_BUTTON_B:
-            mainjoystick.button_b=1;
+            js.button_b=1;
             break;
           case PC_BUTTON_BACK:
-            mainjoystick.button_back=1;
+            js.button_back=1;
             break;
           case PC_BUTTON_START:
-            mainjoystick.button_start=1;
+            js.button_start=1;
             break;
         }
-        mainjoystick.any=1;
+        js.any=1;
         break;
       case SDL_JOYAXISMOTION:
         switch(event.jaxis.axis)
@@ -939,44 +1467,44 @@ void process_events()
           case 0:
             if(event.jaxis.value<0)
             {
-              mainjoystick.left=event.jaxis.value;
-              mainjoystick.right=0;
+              js.left=event.jaxis.value;
+              js.right=0;
               if(event.jaxis.value<-32000)
               {
-                mainjoystick.pad_left=1;
-                mainjoystick.any=1;
+                js.pad_left=1;
+                js.any=1;
               }
             }
             else
             {
-              mainjoystick.right=event.jaxis.value;
-              mainjoystick.left=0;
+              js.right=event.jaxis.value;
+              js.left=0;
               if(event.jaxis.value>32000)
               {
-                mainjoystick.pad_right=1;
-                mainjoystick.any=1;
+                js.pad_right=1;
+                js.any=1;
               }
             }
             break;
           case 1:
             if(event.jaxis.value<0)
             {
-              mainjoystick.up=event.jaxis.value;
-              mainjoystick.down=0;
+              js.up=event.jaxis.value;
+              js.down=0;
               if(event.jaxis.value<-32000)
               {
-                mainjoystick.pad_up=1;
-                mainjoystick.any=1;
+                js.pad_up=1;
+                js.any=1;
               }
             }
             else
             {
-              mainjoystick.down=event.jaxis.value;
-              mainjoystick.up=0;
+              js.down=event.jaxis.value;
+              js.up=0;
               if(event.jaxis.value>32000)
               {
-                mainjoystick.pad_down=1;
-                mainjoystick.any=1;
+                js.pad_down=1;
+                js.any=1;
               }
             }
             break;
@@ -986,19 +1514,19 @@ void process_events()
         switch(event.jhat.value)
         {
           case 1:
-            mainjoystick.pad_up=1;
+            js.pad_up=1;
             break;
           case 2:
-            mainjoystick.pad_right=1;
+            js.pad_right=1;
             break;
           case 4:
-            mainjoystick.pad_down=1;
+            js.pad_down=1;
             break;
           case 8:
-            mainjoystick.pad_left=1;
+            js.pad_left=1;
             break;
         }
-        mainjoystick.any=1;
+        js.any=1;
         break;
 #endif // PLATFORM_WIN
       }
@@ -1049,6 +1577,10 @@ void process_joystick()
     mainjoystick.button_y=1;
   else
     mainjoystick.button_y=0;
+  if(SDL_JoystickGetButton(joystick, GP2X_BUTTON_L))
+    mainjoystick.button_l=1;
+  else
+    mainjoystick.button_l=0;
 #endif // PLATFORM_GP2X
 #ifdef PLATFORM_WIN
   if(keys[SDLK_ESCAPE])
@@ -1096,7 +1628,7 @@ void process_joystick()
     mainjoystick.button_back=1;
   else
     mainjoystick.button_back=0;
-  if(SDL_JoystickGetButton(joystick, PC_BUTTON_L))
+  if(keys[SDLK_q] || SDL_JoystickGetButton(joystick, PC_BUTTON_L))
     mainjoystick.button_l=1;
   else
     mainjoystick.button_l=0;
@@ -1107,145 +1639,101 @@ void process_joystick()
 #endif // PLATFORM_WIN
 }
 
-void draw_menu()
+void draw_menu(const game_snapshot& s)
 {
   SDL_FillRect(screen,NULL,SDL_MapRGB(screen->format,56,152,255));
 
-  SDL_Rect rbubble;
-  for(int i=0; i<bubble_list.size(); i++)
-  {
-    rbubble.x=bubble_list[i].x;
-    rbubble.y=bubble_list[i].y;
-    if(bubble)
-      SDL_BlitSurface(bubble,NULL,screen,&rbubble);
-  }
+  if(bubble)
+    draw_sprites(bubble,s.bubble_x,s.bubble_y);
 
-  draw_text(screen,lang.get_string(1),50,50,255,255,255);
-  draw_text(screen,lang.get_string(6),50,64,255,255,255);
+  draw_text(screen,lang.get_string(STRING_RAFA_VICO_PRESENTS),50,50,255,255,255);
+  draw_text(screen,lang.get_string(STRING_BATHYSCAPHE),50,64,255,255,255);
 
-  draw_text(screen,lang.get_string(2),50,100,255,255,255);
+  draw_text(screen,lang.get_string(STRING_PLAY),50,100,255,255,255);
   draw_text(screen,lang.language_name(lang.language_id()),50,120,255,255,255);
-  draw_text(screen,lang.get_string(3),50,140,255,255,255);
+  draw_text(screen,lang.get_string(STRING_EXIT),50,140,255,255,255);
 
-  switch(menu_selection)
+  switch(s.menu_selection)
   {
     case 0:
-      draw_text(screen,lang.get_string(2),49,99,255,0,0);
+      draw_text(screen,lang.get_string(STRING_PLAY),49,99,255,0,0);
       break;
     case 1:
       draw_text(screen,lang.language_name(lang.language_id()),49,119,255,0,0);
       break;
     case 2:
-      draw_text(screen,lang.get_string(3),49,139,255,0,0);
+      draw_text(screen,lang.get_string(STRING_EXIT),49,139,255,0,0);
       break;
   }
 
-  for(int i=0; i<record_list.size(); i++)
+  for(int i=0; i<s.records.size(); i++)
   {
     char recordline[50];
-    sprintf(recordline,"%i - %s",record_list[i].score, record_list[i].name);
+    sprintf(recordline,"%i - %s",s.records[i].score, s.records[i].name);
     draw_text(screen,recordline,200,50+i*15,192,192,192);
   }
+
+  if(s.loading<100)
+  {
+    SDL_Rect bar;
+    bar.x=50;
+    bar.y=220;
+    bar.w=220*s.loading/100;
+    bar.h=2;
+    SDL_FillRect(screen,&bar,SDL_MapRGB(screen->format,255,255,255));
+  }
 }
 
 void update_menu()
 {
-  // draw menu
-
-  if(rand()%5==0)
-    new_bubble(8+rand()%304,230,1+rand()%2);
+  if(game.random()%5==0)
+    game.new_bubble(8+game.random()%304,230,1+game.random()%2);
   // move bubbles
-  for(int i=0; i<bubble_list.size(); i++)
+  for(int i=0; i<game.bubble_list.size(); i++)
   {
-    bubble_list[i].x+=(int)bubble_list[i].ah-1+rand()%3;
-    bubble_list[i].y+=(int)bubble_list[i].av;
-    if(bubble_list[i].ah<0)
-      bubble_list[i].ah+=0.3;
-    if(bubble_list[i].ah>0)
-      bubble_list[i].ah-=0.3;
-    if(bubble_list[i].av>-1)
-      bubble_list[i].av-=0.3;
-    if(bubble_list[i].y<0)
+    game.bubble_list[i].x+=game.bubble_list[i].ah.to_int()-1+game.random()%3;
+    game.bubble_list[i].y+=game.bubble_list[i].av.to_int();
+    if(game.bubble_list[i].ah<0)
+      game.bubble_list[i].ah+=FX(0.3);
+    if(game.bubble_list[i].ah>0)
+      game.bubble_list[i].ah-=FX(0.3);
+    if(game.bubble_list[i].av>-1)
+      game.bubble_list[i].av-=FX(0.3);
+    if(game.bubble_list[i].y<0)
     {
-      bubble_list.erase(bubble_list.begin()+i);
+      game.bubble_list.erase(game.bubble_list.begin()+i);
       i--;
     }
-    else if(rand()%300==0)
+    else if(game.random()%300==0)
     {
-      bubble_list.erase(bubble_list.begin()+i);
+      game.bubble_list.erase(game.bubble_list.begin()+i);
       i--;
     }
   }
 
   read_menu_keys();
-  draw_menu();
+  play_events();
 }
 
 void read_game_keys()
 {
-  process_events();
+  take_events();
 
-  if(mainjoystick.any && ship_disabled)
-    ship_disabled=false;
+  if(mainjoystick.any && game.ship_disabled)
+    game.ship_disabled=false;
   if(mainjoystick.button_start)
     program_mode=PROGRAM_MODE_MENU;
   if(mainjoystick.button_back || mainjoystick.escape)
     program_mode=PROGRAM_MODE_PAUSE;
 
   process_joystick();
+  if(autopilot)
+    game.autopilot(!stress,mainjoystick.button_a,mainjoystick.pad_left,mainjoystick.pad_right);
 
-  if(mainjoystick.button_a)
-  {
-    if(!ship_disabled)
-    {
-      if(ship_av>-4)
-        ship_av-=0.1;
-      if(!engine_on)
-      {
-        Mix_PlayChannel(4,sound_engine,-1);
-        engine_on=true;
-      }
-    }
-    if(rand()%3==0)
-      new_bubble(ship_x+12,ship_y+22,DIR_DOWN);
-  }
-  else
-  {
-    if(!ship_disabled)
-      if(ship_av<4)
-        ship_av+=0.1;
-    if(engine_on)
-    {
-      Mix_HaltChannel(4);
-      engine_on=false;
-    }
-  }
-
-  if(mainjoystick.pad_left)
-  {
-    if(!ship_disabled)
-      if(ship_ah>-4)
-        ship_ah-=0.1;
-    if(rand()%3==0)
-      new_bubble(ship_x+22,ship_y+7,DIR_RIGHT);
-  }
-  if(mainjoystick.pad_right)
-  {
-    if(!ship_disabled)
-      if(ship_ah<4)
-        ship_ah+=0.1;
-    if(rand()%3==0)
-      new_bubble(ship_x+2,ship_y+7,DIR_LEFT);
-  }
-
-  if(!mainjoystick.pad_left && ship_ah<0 && !ship_disabled)
-    ship_ah+=0.1;
-
-  if(!mainjoystick.pad_right && ship_ah>0 && !ship_disabled)
-    ship_ah-=0.1;
+  game.control(mainjoystick.button_a,mainjoystick.pad_left,mainjoystick.pad_right);
 }
 
-void draw_game()
+void draw_game(const game_snapshot& s)
 {
   // draw layers
   SDL_Rect dest;  // sky
@@ -1282,41 +1770,28 @@ void draw_game()
   rwave.w=20;
   rwave.h=1;
   rwave.y=47;
-  rwave.x=int(water_wave);
+  rwave.x=s.water_wave;
   for(int f=0;f<8;f++)
   {
     SDL_FillRect(screen,&rwave,SDL_MapRGB(screen->format,56,152,255));
     rwave.x+=40;
   }
-  if(water_wave>=20)
+  if(s.water_wave>=20)
   {
     rwave.x=0;
-    rwave.w=int(water_wave-20);
+    rwave.w=s.water_wave-20;
     SDL_FillRect(screen,&rwave,SDL_MapRGB(screen->format,56,152,255));
   }
-  if(program_mode==PROGRAM_MODE_GAME)
-    water_wave+=0.4;
-  if(water_wave>=40)
-    water_wave=0;
 
   // draw treasures
-  SDL_Rect rgold;
-  for(int i=0; i<4; i++)
-  {
-    if(gold_list[i].exist)
-    {
-      rgold.x=gold_list[i].x;
-      rgold.y=gold_list[i].y;
-      if(gold)
-        SDL_BlitSurface(gold,NULL,screen,&rgold);
-    }
-  }
+  if(gold)
+    draw_sprites(gold,s.gold_x,s.gold_y);
 
   // draw bathyscaphe
   SDL_Rect rship;
-  rship.x=ship_x;
-  rship.y=ship_y;
-  if(ship_disabled)
+  rship.x=s.ship_x;
+  rship.y=s.ship_y;
+  if(s.ship_disabled)
   {
     if(shipdisabled)
       SDL_BlitSurface(shipdisabled,NULL,screen,&rship);
@@ -1328,254 +1803,708 @@ void draw_game()
   }
 
   // draw bugs
-  SDL_Rect rbug;
-  for(int i=0; i<bug_list.size(); i++)
-  {
-    rbug.x=bug_list[i].x;
-    rbug.y=bug_list[i].y;
-    if(bug)
-      SDL_BlitSurface(bug,NULL,screen,&rbug);
-  }
+  if(bug)
+    draw_sprites(bug,s.bug_x,s.bug_y);
 
   // draw bubbles
-  SDL_Rect rbubble;
-  for(int i=0; i<bubble_list.size(); i++)
-  {
-    rbubble.x=bubble_list[i].x;
-    rbubble.y=bubble_list[i].y;
-    if(bubble)
-      SDL_BlitSurface(bubble,NULL,screen,&rbubble);
-  }
+  if(bubble)
+    draw_sprites(bubble,s.bubble_x,s.bubble_y);
 
   // draw plants
   SDL_Rect rgreen;
-  for(int i=0; i<green_list.size(); i++)
+  for(int i=0; i<s.plant_x.size(); i++)
   {
-    rgreen.x=green_list[i].x;
-    rgreen.y=green_list[i].y;
-    if(green[int(green_list[i].frame)])
+    rgreen.x=s.plant_x[i];
+    rgreen.y=s.plant_y[i];
+    if(green[s.plant_frame[i]])
     {
-      SDL_BlitSurface(green[int(green_list[i].frame)],NULL,screen,&rgreen);
+      SDL_BlitSurface(green[s.plant_frame[i]],NULL,screen,&rgreen);
     }
   }
 
   // draw clouds
-  SDL_Rect rcloud;
-  for(int i=0; i<cloud_list.size(); i++)
-  {
-    rcloud.x=cloud_list[i].x;
-    rcloud.y=cloud_list[i].y;
-    if(cloud)
-      SDL_BlitSurface(cloud,NULL,screen,&rcloud);
-  }
+  if(cloud)
+    draw_sprites(cloud,s.cloud_x,s.cloud_y);
 
   // draw texts
   char txt[20];
-  sprintf(txt,lang.get_string(4),level);
+  snprintf(txt,sizeof(txt),lang.get_format(STRING_LEVEL),s.level);
   draw_text(screen,txt,10,5,0,0,0);
-  sprintf(txt,lang.get_string(5),score);
+  snprintf(txt,sizeof(txt),lang.get_format(STRING_SCORE),s.score);
   draw_text(screen,txt,250,5,0,0,0);
 }
 
-void update_game()
+///////////////////////////////////
+/*  Simulation passes            */
+///////////////////////////////////
+// bugs, plants and clouds are split in ranges; the hash and the bubbles use
+// shared structures and the game's random numbers, so they run as single jobs
+void move_bugs(void* data, int begin, int end)
 {
-  if(!ship_disabled)
+  game.move_bugs(begin,end);
+}
+
+void move_bug_hash(void* data, int begin, int end)
+{
+  game.move_bug_hash();
+}
+
+void move_bubbles(void* data, int begin, int end)
+{
+  game.move_bubbles();
+}
+
+void move_plants(void* data, int begin, int end)
+{
+  game.move_plants(begin,end);
+}
+
+void move_clouds(void* data, int begin, int end)
+{
+  game.move_clouds(begin,end);
+}
+
+// sounds and exps the game asked for since the last call
+void play_events()
+{
+  for(int f=0; f<game.events.size(); f++)
   {
-    // ship impulse
-    ship_y+=(int)ship_av;
-    ship_x+=(int)ship_ah;
-    if(ship_x<0)
-      ship_x=0;
-    if(ship_x>296)
-      ship_x=296;
-    if(ship_y<48)
+    game_event& e=game.events[f];
+    switch(e.type)
     {
-      ship_y=48;
-      ship_av=0.1;
-    }
-    if(ship_y>204)
-    {
-      ship_y=204;
-      ship_av=0;
+      case EVENT_BUBBLE:
+        play_sound(-1,SOUND_BUBBLE,0);
+        break;
+      case EVENT_HIT:
+        play_sound(-1,SOUND_HIT,0);
+        exps.flag(EXP_FLAG_LOADED,1);
+        break;
+      case EVENT_GOLD:
+        play_sound(-1,SOUND_GOLD,0);
+        exps.flag(EXP_FLAG_LOADED,0);
+        exps.count(EXP_COUNTER_SCORE,e.value);
+        break;
+      case EVENT_ROAR:
+        stop_loop(SOUND_ENGINE);
+        play_sound(-1,SOUND_ROAR,0);
+        exps.happen(EXP_EVENT_CAUGHT,e.value);
+        break;
+      case EVENT_ENGINE_ON:
+        play_sound(-1,SOUND_ENGINE,-1);
+        break;
+      case EVENT_ENGINE_OFF:
+        stop_loop(SOUND_ENGINE);
+        break;
+      case EVENT_DEPTH:
+        exps.enter(e.value);
+        break;
     }
   }
+  game.events.clear();
 
-  // check if get treasure
-  for(int i=0; i<4; i++)
+  // the sea is heard from the moment it has loaded
+  if(!water_playing && assets.ready(sound_files[SOUND_WATER].asset))
   {
-    if(gold_list[i].exist)
-    {
-      if(gold_list[i].carried)
-      {
-        gold_list[i].x=ship_x;
-        gold_list[i].y=ship_y+24;
-      }
-      if(!ship_load && ship_y>=204 && ship_x>gold_list[i].x-4 && ship_x<gold_list[i].x+4)
-      {
-        gold_list[i].carried=1;
-        ship_load=1;
-        Mix_PlayChannel(-1,sound_hit,0);
-      }
-    }
+    play_sound(-1,SOUND_WATER,-1);
+    water_playing=1;
+  }
+}
+
+// step back a frame while L is held; 1 if the game went back
+int rewind_game()
+{
+  if(!mainjoystick.button_l || history.frames()<2)
+    return 0;
+  history.drop(1);
+  game.load(history.newest());
+  if(!game.engine_on)
+    stop_loop(SOUND_ENGINE);
+  // the time at this depth starts again
+  exps.enter(game.depth);
+  exps.flag(EXP_FLAG_LOADED,game.ship_load);
+  take_events();
+  process_joystick();
+  return 1;
+}
+
+void update_game()
+{
+  if(rewind_game())
+    return;
+
+  sim_stats.begin(STAT_UPDATE);
+  game.move_ship();
+
+  // independent passes, the bug hash follows the bugs
+  int bugs_job=jobs.parallel_for(move_bugs,NULL,game.bug_list.size(),JOB_GRAIN);
+  int hash_job=jobs.create(move_bug_hash,NULL,0,0);
+  int bubbles_job=jobs.create(move_bubbles,NULL,0,0);
+  int plants_job=jobs.parallel_for(move_plants,NULL,game.green_list.size(),JOB_GRAIN);
+  int clouds_job=jobs.parallel_for(move_clouds,NULL,game.cloud_list.size(),JOB_GRAIN);
+  jobs.depend(hash_job,bugs_job);
+  jobs.submit(bugs_job);
+  jobs.submit(hash_job);
+  jobs.submit(bubbles_job);
+  jobs.submit(plants_job);
+  jobs.submit(clouds_job);
+  jobs.wait(hash_job);
+  jobs.wait(bubbles_job);
+  jobs.wait(plants_job);
+  jobs.wait(clouds_job);
+  jobs.clear();
+
+  game.end_update();
+  sim_stats.end(STAT_UPDATE);
+
+  if(game.caught)
+    finish();
+  else
+    read_game_keys();
+  play_events();
+  exps.tick();
+
+  if(!stress)
+  {
+    game.save(history_state);
+    history.capture(history_state);
   }
+}
 
-  // check if rescue treasure
-  if(ship_load && ship_y<=48 && ship_x>=136 && ship_x<160)
+void update_end()
+{
+  take_events();
+  process_joystick();
+  // look back at how it ended, a frame a step while L is held
+  if(mainjoystick.button_l)
   {
-    for(int i=0; i<4; i++)
+    if(history.seek(review_back+1,history_state))
     {
-      if(gold_list[i].carried)
-      {
-        gold_list[i].carried=0;
-        gold_list[i].exist=0;
-        ship_load=0;
-        score++;
-        Mix_PlayChannel(-1,sound_gold,0);
-        switch(score)
-        {
-          case 1:
-            exp_win(1);
-            break;
-          case 5:
-            exp_win(2);
-            break;
-          case 10:
-            exp_win(3);
-            break;
-          case 20:
-            exp_win(4);
-            break;
-        }
-      }
+      review_back++;
+      game.load(history_state);
     }
   }
+  else if(mainjoystick.any)
+    program_mode=PROGRAM_MODE_MENU;
+}
 
-  // if get all treasures, advance to next level
-  int boxes=0;
-  for(int i=0; i<4; i++)
+void draw_end(const game_snapshot& s)
+{
+  draw_game(s);
+  draw_text(screen,lang.get_string(STRING_END),151,111,0,0,0);
+  draw_text(screen,lang.get_string(STRING_END),150,110,255,255,255);
+}
+
+void read_pause_keys()
+{
+  take_events();
+
+  if(mainjoystick.button_a || mainjoystick.button_back)
+    program_mode=PROGRAM_MODE_GAME;
+}
+
+void draw_pause(const game_snapshot& s)
+{
+  draw_game(s);
+  draw_text(screen,"Pause",140,110,255,255,0);
+}
+
+void update_pause()
+{
+  read_pause_keys();
+}
+
+///////////////////////////////////
+/*  Stress test                  */
+///////////////////////////////////
+// a game played by drive_autopilot(), no key needed to start
+void start_autopilot()
+{
+  autopilot=1;
+  game.reset();
+  game.new_level();
+  game.ship_disabled=false;
+  history.clear();
+  program_mode=PROGRAM_MODE_GAME;
+}
+
+void start_stress()
+{
+  stress_log=fopen("stress.log","w");
+  if(stress_log)
+    fprintf(stress_log,"bugs\tbubbles\tclouds\tplants\tgold\tframe\tpeak\tupdate\tdraw\texp\tfilter\tflip\twait\t(usec)\n");
+  start_autopilot();
+  game.collisions=0;
+  stress_frame=0;
+}
+
+void report_stress()
+{
+  if(!stress_log)
+    return;
+  SDL_mutexP(stats_lock);
+  fprintf(stress_log,"%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\n",
+          game.bug_list.size(),(int)game.bubble_list.size(),game.cloud_list.size(),game.green_list.size(),game.gold_list.size(),
+          stats.average(STAT_FRAME),stats.maximum(STAT_FRAME),sim_stats.average(STAT_UPDATE),
+          stats.average(STAT_DRAW),stats.average(STAT_EXP),present_stats.average(STAT_FILTER),
+          present_stats.average(STAT_FLIP),stats.average(STAT_WAIT));
+  SDL_mutexV(stats_lock);
+  fflush(stress_log);
+}
+
+// grow the bug count in steps, measuring every step for a while
+void update_stress()
+{
+  if(stress_frame%STRESS_FRAMES==0)
   {
-    if(!gold_list[i].exist)
-      boxes++;
+    int step=stress_frame/STRESS_FRAMES;
+    if(step>0)
+      report_stress();
+    if(step>=STRESS_STEPS)
+    {
+      if(stress_log)
+        fclose(stress_log);
+      done=1;
+      return;
+    }
+    while(game.bug_list.size()<stress_bugs*(step+1)/STRESS_STEPS)
+      game.new_bug();
+    sim_stats.reset();
+    SDL_mutexP(stats_lock);
+    stats.reset();
+    present_stats.reset();
+    SDL_mutexV(stats_lock);
   }
-  if(boxes==4)
-    new_level();
+  if(program_mode==PROGRAM_MODE_GAME)
+    for(int f=0; f<stress_bubbles; f++)
+      game.new_bubble(game.random()%316,52+game.random()%172,DIR_DOWN);
+  stress_frame++;
+}
 
-  // move bugs
-  for(int i=0; i<bug_list.size(); i++)
+///////////////////////////////////
+/*  Soak test                    */
+///////////////////////////////////
+void count_value(std::vector<int>& histogram, int value)
+{
+  if(value>=histogram.size())
+    histogram.resize(value+1,0);
+  histogram[value]++;
+}
+
+// entity counts must stay bounded over any number of games
+void report_soak(int frame, int fps)
+{
+  int games=0;
+  for(int f=0; f<soak_scores.size(); f++)
+    games+=soak_scores[f];
+  fprintf(soak_log,"%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\t%i\n",
+          frame,fps,games,game.level,game.bug_list.size(),game.bug_hash.size(),(int)game.bubble_list.size(),
+          game.gold_list.size(),game.green_list.size(),game.cloud_list.size(),history.frames(),history.used()/1024);
+  fflush(soak_log);
+}
+
+void report_games(FILE* log, std::vector<int>& scores, std::vector<int>& levels, long long frames, long long usec)
+{
+  int games=0;
+  long long level_total=0;
+  for(int f=0; f<levels.size(); f++)
   {
-    bug_list[i].x+=bug_list[i].dir_x;
-    bug_list[i].y+=bug_list[i].dir_y;
-    if(bug_list[i].x<0 || bug_list[i].x>298)
-      bug_list[i].dir_x=-bug_list[i].dir_x;
-    if(bug_list[i].y<48 || bug_list[i].y>204)
-      bug_list[i].dir_y=-bug_list[i].dir_y;
-    // check collision
-    if(!ship_disabled)
-      if(bug_list[i].x>ship_x-20 && bug_list[i].x<ship_x+20 && bug_list[i].y>ship_y-20 && bug_list[i].y<ship_y+20)
-        finish();
+    games+=levels[f];
+    level_total+=(long long)levels[f]*f;
   }
+  fprintf(log,"\n%lld frames in %i ms, %i frames/sec\n",frames,(int)(usec/1000),(int)(frames*1000000LL/(usec>0 ? usec : 1)));
+  fprintf(log,"%i games, level %i at most, %i.%02i on average\n",games,(int)levels.size()-1,
+          games>0 ? (int)(level_total/games) : 0,games>0 ? (int)(level_total*100/games%100) : 0);
+  fprintf(log,"\nscore\tgames\n");
+  for(int f=0; f<scores.size(); f++)
+    if(scores[f]>0)
+      fprintf(log,"%i\t%i\n",f,scores[f]);
+  fprintf(log,"\nlevel\tgames\n");
+  for(int f=0; f<levels.size(); f++)
+    if(levels[f]>0)
+      fprintf(log,"%i\t%i\n",f,levels[f]);
+}
 
-  // move bubbles
-  for(int i=0; i<bubble_list.size(); i++)
+// autopilot games back to back with nothing drawn or heard, as fast as the
+// simulation steps; the game still in play at the end is not counted
+void run_soak()
+{
+  soak_log=fopen("soak.log","w");
+  if(!soak_log)
+    return;
+  fprintf(soak_log,"frame\tfps\tgames\tlevel\tbugs\thash\tbubbles\tgold\tplants\tclouds\trewind\tKB\n");
+
+  start_autopilot();
+  long long start=stats_usec();
+  long long last=start;
+  for(int frame=1; frame<=soak_frames && !done; frame++)
   {
-    bubble_list[i].x+=(int)bubble_list[i].ah-1+rand()%3;
-    bubble_list[i].y+=(int)bubble_list[i].av;
-    if(bubble_list[i].ah<0)
-      bubble_list[i].ah+=0.3;
-    if(bubble_list[i].ah>0)
-      bubble_list[i].ah-=0.3;
-    if(bubble_list[i].av>-1)
-      bubble_list[i].av-=0.3;
-    if(bubble_list[i].y<48)
+    update_game();
+    if(program_mode!=PROGRAM_MODE_GAME)
     {
-      bubble_list.erase(bubble_list.begin()+i);
-      i--;
+      count_value(soak_scores,game.score);
+      count_value(soak_levels,game.level);
+      start_autopilot();
+    }
+    if(frame%SOAK_REPORT==0)
+    {
+      long long now=stats_usec();
+      report_soak(frame,(int)(SOAK_REPORT*1000000LL/(now>last ? now-last : 1)));
+      last=now;
     }
   }
+  report_games(soak_log,soak_scores,soak_levels,soak_frames,stats_usec()-start);
+  fclose(soak_log);
+}
 
-  // move plants
-  for(int i=0; i<green_list.size(); i++)
-  {
-    green_list[i].frame+=0.2;
-    if(green_list[i].frame>3.9)
-      green_list[i].frame=0;
-  }
+///////////////////////////////////
+/*  Batch test                   */
+///////////////////////////////////
+void start_batch_game(batch_game* b)
+{
+  b->game.reset();
+  b->game.new_level();
+  b->game.ship_disabled=false;
+}
 
-  // move clouds
-  for(int i=0; i<cloud_list.size(); i++)
+// each instance plays autopilot games back to back for soak_frames frames
+void run_batch_games(void* data, int begin, int end)
+{
+  for(int i=begin; i<end; i++)
   {
-    if(cloud_list[i].frame>0)
+    batch_game* b=batch_list[i];
+    for(int frame=0; frame<soak_frames; frame++)
     {
-      cloud_list[i].frame+=cloud_list[i].vel;
-      if(cloud_list[i].frame>3.9)
+      b->game.update();
+      if(b->game.caught)
       {
-        cloud_list[i].frame=0.1;
-        cloud_list[i].x+=1;
-        if(cloud_list[i].x>319)
-          cloud_list[i].x=-48;
+        count_value(b->scores,b->game.score);
+        count_value(b->levels,b->game.level);
+        start_batch_game(b);
       }
-    }
-    else
-    {
-      cloud_list[i].frame-=cloud_list[i].vel;
-      if(cloud_list[i].frame<-3.9)
+      else
       {
-        cloud_list[i].frame=-0.1;
-        cloud_list[i].x-=1;
-        if(cloud_list[i].x<-48)
-          cloud_list[i].x=320;
+        int thrust, left, right;
+        b->game.autopilot(1,thrust,left,right);
+        b->game.control(thrust,left,right);
       }
+      b->game.events.clear();
     }
   }
+}
+
+// independent games on every core, seeded batch_seed, batch_seed+1, ...
+void run_batch()
+{
+  FILE* batch_log=fopen("batch.log","w");
+  if(!batch_log)
+    return;
 
-  // check exp times
-  if(ship_y==48 || ship_y==204)
-    floating_time=SDL_GetTicks();
-  if(ship_y!=204)
-    floor_time=SDL_GetTicks();
-  if((SDL_GetTicks()-floating_time)/1000>=30)
+  for(int i=0; i<batch; i++)
   {
-    if(ship_load)
-      exp_win(7);
-    else
-      exp_win(6);
+    batch_game* b=new batch_game;
+    b->game.seed(batch_seed+i);
+    b->game.treasure_count=game.treasure_count;
+    b->game.cloud_count=game.cloud_count;
+    b->game.plant_count=game.plant_count;
+    b->game.ship_mask=&ship_mask;
+    b->game.bug_mask=&bug_mask;
+    b->game.gold_mask=&gold_mask;
+    start_batch_game(b);
+    batch_list.push_back(b);
   }
-  if((SDL_GetTicks()-floor_time)/1000>=60)
-    exp_win(8);
 
-  read_game_keys();
-  draw_game();
+  long long start=stats_usec();
+  int id=jobs.parallel_for(run_batch_games,NULL,batch,1);
+  jobs.submit(id);
+  jobs.wait(id);
+  jobs.clear();
+  long long usec=stats_usec()-start;
+
+  std::vector<int> scores;
+  std::vector<int> levels;
+  for(int i=0; i<batch; i++)
+  {
+    batch_game* b=batch_list[i];
+    for(int f=0; f<b->scores.size(); f++)
+      for(int n=0; n<b->scores[f]; n++)
+        count_value(scores,f);
+    for(int f=0; f<b->levels.size(); f++)
+      for(int n=0; n<b->levels[f]; n++)
+        count_value(levels,f);
+    delete b;
+  }
+  batch_list.clear();
+
+  fprintf(batch_log,"%i games at once, %i frames each, seeds from %u, %i threads\n",batch,soak_frames,batch_seed,jobs.threads());
+  report_games(batch_log,scores,levels,(long long)batch*soak_frames,usec);
+  fclose(batch_log);
 }
 
-void update_end()
+///////////////////////////////////
+/*  Simulation and render        */
+///////////////////////////////////
+void merge_joystick_state(joystick_state& dst, const joystick_state& src)
 {
-  process_events();
-  if(mainjoystick.any)
-    program_mode=PROGRAM_MODE_MENU;
+  if(src.left)
+    dst.left=src.left;
+  if(src.right)
+    dst.right=src.right;
+  if(src.up)
+    dst.up=src.up;
+  if(src.down)
+    dst.down=src.down;
+  if(src.pad_left)
+    dst.pad_left=src.pad_left;
+  if(src.pad_right)
+    dst.pad_right=src.pad_right;
+  if(src.pad_up)
+    dst.pad_up=src.pad_up;
+  if(src.pad_down)
+    dst.pad_down=src.pad_down;
+  if(src.button_a)
+    dst.button_a=src.button_a;
+  if(src.button_b)
+    dst.button_b=src.button_b;
+  if(src.button_x)
+    dst.button_x=src.button_x;
+  if(src.button_y)
+    dst.button_y=src.button_y;
+  if(src.button_l)
+    dst.button_l=src.button_l;
+  if(src.button_r)
+    dst.button_r=src.button_r;
+  if(src.button_back)
+    dst.button_back=src.button_back;
+  if(src.button_start)
+    dst.button_start=src.button_start;
+  if(src.escape)
+    dst.escape=src.escape;
+  if(src.any)
+    dst.any=src.any;
+}
 
-  draw_game();
-  draw_text(screen,lang.get_string(7),151,111,0,0,0);
-  draw_text(screen,lang.get_string(7),150,110,255,255,255);
+// main thread: add new presses to those the simulation has not taken yet
+void poll_events()
+{
+  joystick_state js;
+  process_events(js);
+  SDL_mutexP(input_lock);
+  merge_joystick_state(input_events,js);
+  SDL_mutexV(input_lock);
 }
 
-void read_pause_keys()
+// simulation: presses since the last call, in place of process_events()
+void take_events()
 {
-  process_events();
+  SDL_mutexP(input_lock);
+  mainjoystick=input_events;
+  clear_joystick_state(input_events);
+  SDL_mutexV(input_lock);
+}
 
-  if(mainjoystick.button_a || mainjoystick.button_back)
-    program_mode=PROGRAM_MODE_GAME;
+// copy what drawing needs; vectors keep their capacity between frames
+void publish_snapshot()
+{
+  game_snapshot& s=snapshots.write_buffer();
+  s.program_mode=program_mode;
+  s.menu_selection=menu_selection;
+  s.language=language_selected;
+  s.level=game.level;
+  s.score=game.score;
+  s.ship_disabled=game.ship_disabled;
+  s.ship_x=game.ship_x;
+  s.ship_y=game.ship_y;
+  s.water_wave=game.water_wave.to_int();
+  s.loading=assets.count()>0 ? assets.loaded()*100/assets.count() : 100;
+  s.gold_x=game.gold_list.x;
+  s.gold_y=game.gold_list.y;
+  s.bug_x=game.bug_list.x;
+  s.bug_y=game.bug_list.y;
+  s.bubble_x.resize(game.bubble_list.size());
+  s.bubble_y.resize(game.bubble_list.size());
+  for(int i=0; i<game.bubble_list.size(); i++)
+  {
+    s.bubble_x[i]=game.bubble_list[i].x;
+    s.bubble_y[i]=game.bubble_list[i].y;
+  }
+  s.plant_x=game.green_list.x;
+  s.plant_y=game.green_list.y;
+  s.plant_frame.resize(game.green_list.size());
+  for(int i=0; i<game.green_list.size(); i++)
+    s.plant_frame[i]=game.green_list.frame[i].to_int();
+  s.cloud_x=game.cloud_list.x;
+  s.cloud_y=game.cloud_list.y;
+  s.records=record_list;
+  snapshots.publish();
 }
 
-void draw_pause()
+void step_simulation()
 {
-  draw_game();
-  draw_text(screen,"Pause",140,110,255,255,0);
+  switch(program_mode)
+  {
+    case PROGRAM_MODE_MENU:
+      update_menu();
+      break;
+    case PROGRAM_MODE_GAME:
+      update_game();
+      break;
+    case PROGRAM_MODE_PAUSE:
+      update_pause();
+      break;
+    case PROGRAM_MODE_END:
+      update_end();
+      break;
+  }
+  if(stress)
+    update_stress();
+  sim_stats.next_frame();
+  publish_snapshot();
 }
 
-void update_pause()
+// simulation thread: 60 steps a second, stress steps as fast as it can
+int simulation_main(void* data)
 {
-  read_pause_keys();
-  draw_pause();
+  Uint32 next_time=SDL_GetTicks();
+  while(!done)
+  {
+    step_simulation();
+    next_time+=1000/GAME_FPS;
+    Sint32 wait=(Sint32)(next_time-SDL_GetTicks());
+    if(stress || wait<-100)   // do not rush to catch up after a stall
+      next_time=SDL_GetTicks();
+    else if(wait>0)
+      SDL_Delay(wait);
+  }
+  return 0;
+}
+
+///////////////////////////////////
+/*  Presenter                    */
+///////////////////////////////////
+void show_frame(SDL_Surface *src)
+{
+  present_stats.begin(STAT_FILTER);
+  filter_surface(src,screen2);
+  present_stats.end(STAT_FILTER);
+  present_stats.begin(STAT_FLIP);
+  SDL_Flip(screen2);
+  present_stats.end(STAT_FLIP);
+  if(!first_frame_usec)
+    first_frame_usec=stats_usec()-start_usec;
+  SDL_mutexP(stats_lock);
+  present_stats.next_frame();
+  SDL_mutexV(stats_lock);
+}
+
+// presenter thread: show each buffer handed over, then give it back
+int present_main(void* data)
+{
+  for(;;)
+  {
+    SDL_mutexP(present_lock);
+    while(present_running && frame_queued<0)
+      SDL_CondWait(present_cond,present_lock);
+    int f=frame_queued;
+    frame_queued=-1;
+    SDL_mutexV(present_lock);
+    if(f<0)
+      break;
+
+    show_frame(frame_buffer[f]);
+
+    SDL_mutexP(present_lock);
+    frame_busy[f]=0;
+    SDL_CondBroadcast(present_cond);
+    SDL_mutexV(present_lock);
+  }
+  return 0;
+}
+
+void start_presenter()
+{
+  frame_buffer[0]=screen;
+  frame_buffer[1]=SDL_CreateRGBSurface(SDL_SRCCOLORKEY, 320, 240, 16, 0,0,0,0);
+  if(frame_buffer[1]==NULL)
+    return;
+  present_lock=SDL_CreateMutex();
+  present_cond=SDL_CreateCond();
+  present_running=1;
+  present_thread=SDL_CreateThread(present_main,NULL);
+}
+
+// shows the frame still queued before returning
+void stop_presenter()
+{
+  if(!present_thread)
+    return;
+  SDL_mutexP(present_lock);
+  present_running=0;
+  SDL_CondBroadcast(present_cond);
+  SDL_mutexV(present_lock);
+  SDL_WaitThread(present_thread,NULL);
+  present_thread=NULL;
+}
+
+// queue the frame drawn in screen and draw the next one in the other buffer;
+// that buffer holds the previous frame, so wait until it has been shown
+void present_frame()
+{
+  if(!present_thread)
+  {
+    show_frame(screen);
+    return;
+  }
+
+  int other=1-frame_current;
+  stats.begin(STAT_WAIT);
+  SDL_mutexP(present_lock);
+  while(frame_busy[other])
+    SDL_CondWait(present_cond,present_lock);
+  frame_busy[frame_current]=1;
+  frame_queued=frame_current;
+  SDL_CondBroadcast(present_cond);
+  SDL_mutexV(present_lock);
+  stats.end(STAT_WAIT);
+
+  frame_current=other;
+
+  screen=frame_buffer[frame_current];
+}
+
+// main thread: draw the newest snapshot, then exps, zoom and flip
+void render_frame()
+{
+  game_snapshot& s=snapshots.read_buffer();
+  if(s.language!=lang.language_id())
+    lang.set_language(s.language);
+
+  stats.begin(STAT_DRAW);
+  switch(s.program_mode)
+  {
+    case PROGRAM_MODE_MENU:
+      draw_menu(s);
+      break;
+    case PROGRAM_MODE_GAME:
+      draw_game(s);
+      break;
+    case PROGRAM_MODE_PAUSE:
+      draw_pause(s);
+      break;
+    case PROGRAM_MODE_END:
+      draw_end(s);
+      break;
+  }
+  stats.end(STAT_DRAW);
+
+  flush_exp();
+  if(notice_surface || notices.size()>0)
+  {
+    stats.begin(STAT_EXP);
+    draw_notice();
+    stats.end(STAT_EXP);
+  }
+
+  present_frame();
 }
 
 ///////////////////////////////////
@@ -1583,65 +2512,175 @@ void update_pause()
 ///////////////////////////////////
 int main(int argc, char *argv[])
 {
+  start_usec=stats_usec();
   for(int f=0; f<argc; f++)
   {
     if(std::string(argv[f])=="-fullscreen")
       fullscreen=SDL_FULLSCREEN;
     if(std::string(argv[f])=="-scanlines")
       scanlines=1;
+    if(std::string(argv[f])=="-stress")
+      stress=1;
+    if(std::string(argv[f])=="-soak")
+      soak=1;
+    if(std::string(argv[f])=="-startup")
+      startup_log=1;
+    if(std::string(argv[f])=="-autotune")
+      audio_autotune=1;
+    if(std::string(argv[f])=="-audiolog")
+      audio_log=1;
+    if(std::string(argv[f])=="-loose")
+      pack.loose=1;
+    if(std::string(argv[f])=="-cook")
+      cook=1;
+    if(std::string(argv[f])=="-simthread")
+      sim_threaded=1;
+    if(std::string(argv[f])=="-nosimthread")
+      sim_threaded=0;
+    if(std::string(argv[f])=="-presenter")
+      presenter=1;
+    if(std::string(argv[f])=="-nopresenter")
+      presenter=0;
+    if(f+1<argc)
+    {
+      if(std::string(argv[f])=="-threads")
+        job_threads=atoi(argv[f+1]);
+      if(std::string(argv[f])=="-frames" && atoi(argv[f+1])>0)
+        soak_frames=atoi(argv[f+1]);
+      if(std::string(argv[f])=="-batch" && atoi(argv[f+1])>0)
+        batch=atoi(argv[f+1]);
+      if(std::string(argv[f])=="-seed")
+        batch_seed=atoi(argv[f+1]);
+      if(std::string(argv[f])=="-bugs" && atoi(argv[f+1])>=0)
+        stress_bugs=atoi(argv[f+1]);
+      if(std::string(argv[f])=="-bubbles" && atoi(argv[f+1])>=0)
+        stress_bubbles=atoi(argv[f+1]);
+      if(std::string(argv[f])=="-clouds" && atoi(argv[f+1])>=0)
+        game.cloud_count=atoi(argv[f+1]);
+      if(std::string(argv[f])=="-plants" && atoi(argv[f+1])>=0)
+        game.plant_count=atoi(argv[f+1]);
+      if(std::string(argv[f])=="-treasures" && atoi(argv[f+1])>0)
+        game.treasure_count=atoi(argv[f+1]);
+      if(std::string(argv[f])=="-rate" && atoi(argv[f+1])>0)
+        audio_rate=atoi(argv[f+1]);
+      if(std::string(argv[f])=="-channels" && atoi(argv[f+1])>0)
+        audio_channels=atoi(argv[f+1]);
+      if(std::string(argv[f])=="-audioformat")
+        audio_format=atoi(argv[f+1])==8 ? AUDIO_U8 : AUDIO_S16;
+      if(std::string(argv[f])=="-audiobuffer" && atoi(argv[f+1])>=AUDIO_MIN_BUFFER && atoi(argv[f+1])<=AUDIO_MAX_BUFFER)
+        audio_buffer=atoi(argv[f+1]);
+    }
   }
 
-  if(SDL_Init(SDL_INIT_JOYSTICK | SDL_INIT_VIDEO | SDL_INIT_AUDIO)<0)
+#ifdef EMBED_ASSETS
+  pack.open(embedded_pack,embedded_pack_size);
+#else
+  pack.open("data.pak");
+#endif
+  lang.read_languages(pack);
+
+  // soak, batch and cook runs have no window, sound or joystick; screen only
+  // gives the pixel format the sprites are loaded with
+  if(batch)
+    soak=0;
+  headless=soak || batch || cook;
+  if(SDL_Init(headless ? 0 : SDL_INIT_JOYSTICK | SDL_INIT_VIDEO | SDL_INIT_AUDIO)<0)
 		return 0;
 
-  screen2 = SDL_SetVideoMode(640, 480, 16, SDL_DOUBLEBUF | SDL_SWSURFACE | fullscreen);
-  if (screen2==NULL)
-    return 0;
+  if(!headless)
+  {
+    screen2 = SDL_SetVideoMode(640, 480, 16, SDL_DOUBLEBUF | SDL_SWSURFACE | fullscreen);
+    if (screen2==NULL)
+      return 0;
+  }
   screen=SDL_CreateRGBSurface(SDL_SRCCOLORKEY, 320, 240, 16, 0,0,0,0);
   if(screen==NULL)
     return 0;
 
-  SDL_JoystickEventState(SDL_ENABLE);
-  joystick=SDL_JoystickOpen(0);
-  SDL_ShowCursor(0);
+  if(!headless)
+  {
+    SDL_JoystickEventState(SDL_ENABLE);
+    joystick=SDL_JoystickOpen(0);
+    SDL_ShowCursor(0);
+  }
+
+  input_lock=SDL_CreateMutex();
+  exp_lock=SDL_CreateMutex();
+  stats_lock=SDL_CreateMutex();
+  clear_joystick_state(input_events);
+  clear_joystick_state(mainjoystick);
+
+  if(job_threads<0)
+    job_threads=cpu_count()-1;
+  jobs.start(job_threads);
 
   init_game();
+  if(headless)
+  {
+    if(cook)
+    {
+      assets.wait();
+      lang.write_compiled();
+    }
+    else if(soak)
+      run_soak();
+    else
+      run_batch();
+    jobs.stop();
+    end_game();
+    return 1;
+  }
   load_records();
   init_exp();
+  if(stress)
+    start_stress();
+
+  // a single core gains nothing from a second thread but the switches
+  if(sim_threaded<0)
+    sim_threaded=cpu_count()>1;
+  if(sim_threaded)
+    sim_thread=SDL_CreateThread(simulation_main,NULL);
+  if(presenter<0)
+    presenter=cpu_count()>1;
+  if(presenter)
+    start_presenter();
 
-  const int GAME_FPS=60;
   Uint32 start_time;
 
   while(!done)
 	{
     start_time=SDL_GetTicks();
-    switch(program_mode)
+    stats.begin(STAT_FRAME);
+    poll_events();
+    fill_streams();
+    tune_audio();
+    if(!sim_thread)
+      step_simulation();
+    if(snapshots.update())
     {
-      case PROGRAM_MODE_MENU:
-        update_menu();
-        break;
-      case PROGRAM_MODE_GAME:
-        update_game();
-        break;
-      case PROGRAM_MODE_PAUSE:
-        update_pause();
-        break;
-      case PROGRAM_MODE_END:
-        update_end();
-        break;
+      render_frame();
+      stats.end(STAT_FRAME);
+      SDL_mutexP(stats_lock);
+      stats.next_frame();
+      SDL_mutexV(stats_lock);
     }
+    else
+      SDL_Delay(1);   // the simulation has not finished a new frame
 
-    exp_update();
-
-    filter_surface(screen,screen2);
-    SDL_Flip(screen2);
-
-    // set FPS 60
-    if(1000/GAME_FPS>SDL_GetTicks()-start_time)
+    // set FPS 60, stress runs as fast as it can; the thread paces itself
+    if(!sim_thread && !stress && 1000/GAME_FPS>SDL_GetTicks()-start_time)
       SDL_Delay(1000/GAME_FPS-(SDL_GetTicks()-start_time));
 	}
 
+  if(sim_thread)
+    SDL_WaitThread(sim_thread,NULL);
+  stop_presenter();
+  jobs.stop();
   end_game();
+  if(startup_log)
+    write_startup_log();
+  if(audio_log)
+    write_audio_log();
   save_records();
   exp_end();
 
@@ -0,0 +1,260 @@
+#include <vector>
+#include "../inc/rewind.h"
+
+///////////////////////////////////
+/*  Record encoding              */
+///////////////////////////////////
+// A record is the section count and sizes, then each value minus the same
+// value of the base state (0 past the end of a base section), zigzag
+// varints; a run of unchanged values is a 0 byte and the run length.
+static void put_varint(std::vector<unsigned char>& out, unsigned int v)
+{
+  while(v>=0x80)
+  {
+    out.push_back((unsigned char)(v|0x80));
+    v>>=7;
+  }
+  out.push_back((unsigned char)v);
+}
+
+static unsigned int get_varint(const unsigned char*& p)
+{
+  unsigned int v=0;
+  int shift=0;
+  while(*p&0x80)
+  {
+    v|=(unsigned int)(*p++&0x7f)<<shift;
+    shift+=7;
+  }
+  v|=(unsigned int)(*p++)<<shift;
+  return v;
+}
+
+rewind_buffer::rewind_buffer(int bytes, int frames, int keyframe_every)
+{
+  data.resize(bytes);
+  // a whole keyframe group more than asked, so dropping one still
+  // leaves the frames asked for
+  record_start.resize(frames+keyframe_every);
+  record_size.resize(frames+keyframe_every);
+  record_key.resize(frames+keyframe_every);
+  key_interval=keyframe_every;
+  clear();
+}
+
+rewind_buffer::~rewind_buffer()
+{
+}
+
+void rewind_buffer::clear()
+{
+  first=0;
+  count=0;
+  head=0;
+  since_key=0;
+  last.clear();
+}
+
+void rewind_buffer::encode(const std::vector<int>& state, const std::vector<int>& base)
+{
+  packed.clear();
+  int sections=state[0];
+  int base_sections=base.size()>0 ? base[0] : 0;
+  put_varint(packed,sections);
+  for(int s=0; s<sections; s++)
+    put_varint(packed,state[1+s]);
+
+  int at=1+sections;
+  int base_at=1+base_sections;
+  int run=0;
+  for(int s=0; s<sections; s++)
+  {
+    int n=state[1+s];
+    int base_n=s<base_sections ? base[1+s] : 0;
+    for(int i=0; i<n; i++)
+    {
+      unsigned int diff=(unsigned int)state[at+i]-(unsigned int)(i<base_n ? base[base_at+i] : 0);
+      if(diff==0)
+      {
+        run++;
+        continue;
+      }
+      if(run>0)
+      {
+        packed.push_back(0);
+        put_varint(packed,run);
+        run=0;
+      }
+      put_varint(packed,(diff<<1)^(unsigned int)((int)diff>>31));
+    }
+    at+=n;
+    base_at+=base_n;
+  }
+  if(run>0)
+  {
+    packed.push_back(0);
+    put_varint(packed,run);
+  }
+}
+
+void rewind_buffer::decode(int record, const std::vector<int>& base, std::vector<int>& out)
+{
+  const unsigned char* p=&data[record_start[record]];
+  int sections=get_varint(p);
+  int base_sections=base.size()>0 ? base[0] : 0;
+  out.resize(1+sections);
+  out[0]=sections;
+  int total=0;
+  for(int s=0; s<sections; s++)
+  {
+    out[1+s]=get_varint(p);
+    total+=out[1+s];
+  }
+  out.resize(1+sections+total);
+
+  int at=1+sections;
+  int base_at=1+base_sections;
+  int run=0;
+  for(int s=0; s<sections; s++)
+  {
+    int n=out[1+s];
+    int base_n=s<base_sections ? base[1+s] : 0;
+    for(int i=0; i<n; i++)
+    {
+      unsigned int diff=0;
+      if(run>0)
+        run--;
+      else
+      {
+        unsigned int v=get_varint(p);
+        if(v==0)
+          run=get_varint(p)-1;
+        else
+          diff=(v>>1)^(0-(v&1));
+      }
+      out[at+i]=(int)((unsigned int)(i<base_n ? base[base_at+i] : 0)+diff);
+    }
+    at+=n;
+    base_at+=base_n;
+  }
+}
+
+///////////////////////////////////
+/*  Ring                         */
+///////////////////////////////////
+// the oldest frame and the deltas that depended on it
+void rewind_buffer::drop_oldest()
+{
+  do
+  {
+    first=(first+1)%record_start.size();
+    count--;
+  }
+  while(count>0 && !record_key[first]);
+}
+
+// free size bytes at head, oldest frames first; 0 if they never fit
+int rewind_buffer::make_room(int size)
+{
+  if(size>data.size())
+  {
+    clear();
+    return 0;
+  }
+  if(head+size>data.size())
+  {
+    // the end of data is left unused; the frames there are the oldest
+    while(count>0 && record_start[first]>=head)
+      drop_oldest();
+    head=0;
+  }
+  while(count>0 && record_start[first]>=head && record_start[first]<head+size)
+    drop_oldest();
+  if(count==record_start.size())
+    drop_oldest();
+  return 1;
+}
+
+void rewind_buffer::capture(const std::vector<int>& state)
+{
+  static const std::vector<int> none;
+  int key=count==0 || since_key+1>=key_interval;
+  encode(state,key ? none : last);
+  if(!make_room(packed.size()))
+    return;
+  if(count==0 && !key)
+  {
+    // the frame the delta was taken from is gone
+    key=1;
+    encode(state,none);
+    if(!make_room(packed.size()))
+      return;
+  }
+
+  int r=(first+count)%record_start.size();
+  record_start[r]=head;
+  record_size[r]=packed.size();
+  record_key[r]=key;
+  for(int f=0; f<packed.size(); f++)
+    data[head+f]=packed[f];
+  head+=packed.size();
+  count++;
+  since_key=key ? 0 : since_key+1;
+  last=state;
+}
+
+int rewind_buffer::frames()
+{
+  return count;
+}
+
+// the state back frames before the newest one; 0 if it is not held
+int rewind_buffer::seek(int back, std::vector<int>& state)
+{
+  if(back<0 || back>=count)
+    return 0;
+  int size=record_start.size();
+  int target=count-1-back;
+  int k=target;
+  while(!record_key[(first+k)%size])
+    k--;
+  static const std::vector<int> none;
+  decode((first+k)%size,none,state);
+  for(k++; k<=target; k++)
+  {
+    decode((first+k)%size,state,scratch);
+    state.swap(scratch);
+  }
+  return 1;
+}
+
+// forget the newest n frames, as play goes on from an older one
+void rewind_buffer::drop(int n)
+{
+  if(n>=count)
+  {
+    clear();
+    return;
+  }
+  seek(n,last);
+  count-=n;
+  int r=(first+count-1)%record_start.size();
+  head=record_start[r]+record_size[r];
+  since_key=0;
+  for(int k=count-1; !record_key[(first+k)%record_start.size()]; k--)
+    since_key++;
+}
+
+const std::vector<int>& rewind_buffer::newest()
+{
+  return last;
+}
+
+// bytes taken by the frames held
+int rewind_buffer::used()
+{
+  int total=0;
+  for(int f=0; f<count; f++)
+    total+=record_size[(first+f)%record_start.size()];
+  return total;
+}
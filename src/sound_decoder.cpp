@@ -0,0 +1,408 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "../inc/sound_decoder.h"
+
+#define WAV_PCM         1
+#define WAV_IMA_ADPCM   0x11
+#define PCM_READ        1024      // frames read from a PCM file at once
+
+static const int ima_index[16]=
+{
+  -1,-1,-1,-1,2,4,6,8,
+  -1,-1,-1,-1,2,4,6,8
+};
+
+static const int ima_step[89]=
+{
+  7,8,9,10,11,12,13,14,16,17,19,21,23,25,28,31,34,37,41,45,50,55,60,66,
+  73,80,88,97,107,118,130,143,157,173,190,209,230,253,279,307,337,371,
+  408,449,494,544,598,658,724,796,876,963,1060,1166,1282,1411,1552,1707,
+  1878,2066,2272,2499,2749,3024,3327,3660,4026,4428,4871,5358,5894,6484,
+  7132,7845,8630,9493,10442,11487,12635,13899,15289,16818,18500,20350,
+  22385,24623,27086,29794,32767
+};
+
+// little endian fields of a WAV header
+static int read_u16(const unsigned char* p)
+{
+  return p[0]|(p[1]<<8);
+}
+
+static long read_u32(const unsigned char* p)
+{
+  return (long)p[0]|((long)p[1]<<8)|((long)p[2]<<16)|((long)p[3]<<24);
+}
+
+sound_decoder::sound_decoder()
+{
+  type=DECODER_NONE;
+  file=NULL;
+  mem=NULL;
+}
+
+sound_decoder::~sound_decoder()
+{
+  close();
+}
+
+// 0 if the file is missing or of no kind this decoder reads
+int sound_decoder::open(const char* name)
+{
+  close();
+  file=fopen(name,"rb");
+  if(!file)
+    return 0;
+  return open_source();
+}
+
+// the same from a file already in memory, read in place; data must stay
+// there until close()
+int sound_decoder::open(const void* data, long size)
+{
+  close();
+  mem=(const unsigned char*)data;
+  mem_size=size;
+  mem_pos=0;
+  return open_source();
+}
+
+int sound_decoder::open_source()
+{
+  unsigned char magic[4];
+  if(read_bytes(magic,4))
+  {
+    seek_to(0);
+    if(!memcmp(magic,"RIFF",4) && open_wav())
+      return 1;
+    if(!memcmp(magic,"OggS",4) && open_ogg())
+      return 1;
+  }
+  close();
+  return 0;
+}
+
+///////////////////////////////////
+/*  Source access                */
+///////////////////////////////////
+// 1 if all size bytes were there
+int sound_decoder::read_bytes(void* dst, long size)
+{
+  if(file)
+    return fread(dst,size,1,file)==1;
+  if(size>mem_size-mem_pos)
+    return 0;
+  memcpy(dst,mem+mem_pos,size);
+  mem_pos+=size;
+  return 1;
+}
+
+int sound_decoder::seek_to(long pos)
+{
+  if(file)
+    return fseek(file,pos,SEEK_SET)==0;
+  if(pos<0 || pos>mem_size)
+    return 0;
+  mem_pos=pos;
+  return 1;
+}
+
+long sound_decoder::tell()
+{
+  return file ? ftell(file) : mem_pos;
+}
+
+#ifdef USE_TREMOR
+// Tremor reads through these, from the file or the memory alike
+size_t sound_decoder::ogg_read(void* dst, size_t size, size_t count, void* source)
+{
+  sound_decoder* d=(sound_decoder*)source;
+  if(d->file)
+    return fread(dst,size,count,d->file);
+  long n=size>0 ? (d->mem_size-d->mem_pos)/(long)size : 0;
+  if(n>(long)count)
+    n=count;
+  d->read_bytes(dst,n*size);
+  return n;
+}
+
+int sound_decoder::ogg_seek(void* source, ogg_int64_t offset, int whence)
+{
+  sound_decoder* d=(sound_decoder*)source;
+  if(d->file)
+    return fseek(d->file,(long)offset,whence);
+  long base=whence==SEEK_CUR ? d->mem_pos : whence==SEEK_END ? d->mem_size : 0;
+  return d->seek_to(base+(long)offset) ? 0 : -1;
+}
+
+int sound_decoder::ogg_close(void* source)
+{
+  return 0;
+}
+
+long sound_decoder::ogg_tell(void* source)
+{
+  return ((sound_decoder*)source)->tell();
+}
+#endif
+
+int sound_decoder::open_wav()
+{
+  unsigned char header[28];
+  if(!read_bytes(header,12) || memcmp(header+8,"WAVE",4))
+    return 0;
+  int format=0;
+  int bits=0;
+  channels=0;
+  data_size=0;
+  while(read_bytes(header,8))
+  {
+    long size=read_u32(header+4);
+    if(!memcmp(header,"fmt ",4) && size>=16)
+    {
+      int extra=size>=20 ? 20 : 16;
+      if(!read_bytes(header+8,extra))
+        return 0;
+      format=read_u16(header+8);
+      channels=read_u16(header+10);
+      file_rate=read_u32(header+12);
+      block_align=read_u16(header+20);
+      bits=read_u16(header+22);
+      block_frames=extra==20 ? read_u16(header+26) : 0;
+      size-=extra;
+    }
+    else if(!memcmp(header,"data",4))
+    {
+      data_start=tell();
+      data_size=size;
+      break;
+    }
+    if(!seek_to(tell()+size+(size&1)))
+      break;
+  }
+  if(channels<1 || file_rate<=0 || data_size<=0)
+    return 0;
+
+  if(format==WAV_PCM && (bits==8 || bits==16))
+  {
+    type=DECODER_PCM;
+    bytes=bits/8;
+    data_size-=data_size%(channels*bytes);
+    raw.resize(PCM_READ*channels*bytes);
+  }
+  else if(format==WAV_IMA_ADPCM && bits==4 && block_align>4*channels)
+  {
+    type=DECODER_ADPCM;
+    int frames=(block_align-4*channels)*2/channels+1;
+    if(block_frames<=0 || block_frames>frames)
+      block_frames=frames;
+    raw.resize(block_align);
+    block.resize(block_frames*2);
+  }
+  else
+    return 0;
+  data_pos=0;
+  block_count=0;
+  block_pos=0;
+  return 1;
+}
+
+int sound_decoder::open_ogg()
+{
+#ifdef USE_TREMOR
+  ov_callbacks callbacks;
+  callbacks.read_func=ogg_read;
+  callbacks.seek_func=ogg_seek;
+  callbacks.close_func=ogg_close;
+  callbacks.tell_func=ogg_tell;
+  if(ov_open_callbacks(this,&ogg,NULL,0,callbacks)<0)
+    return 0;
+  vorbis_info* info=ov_info(&ogg,-1);
+  if(!info || info->channels<1)
+  {
+    ov_clear(&ogg);
+    return 0;
+  }
+  type=DECODER_OGG;
+  channels=info->channels;
+  file_rate=info->rate;
+  raw.resize(4096);
+  block.resize(4096);
+  block_count=0;
+  block_pos=0;
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+void sound_decoder::close()
+{
+#ifdef USE_TREMOR
+  if(type==DECODER_OGG)
+    ov_clear(&ogg);
+#endif
+  if(file)
+    fclose(file);
+  file=NULL;
+  mem=NULL;
+  type=DECODER_NONE;
+}
+
+int sound_decoder::kind()
+{
+  return type;
+}
+
+int sound_decoder::rate()
+{
+  return file_rate;
+}
+
+int sound_decoder::read_pcm(int* dst, int frames)
+{
+  int frame_bytes=channels*bytes;
+  int n=(data_size-data_pos)/frame_bytes;
+  if(n>frames)
+    n=frames;
+  if(n>PCM_READ)
+    n=PCM_READ;
+  if(n<=0 || !read_bytes(&raw[0],n*frame_bytes))
+    return 0;
+  data_pos+=n*frame_bytes;
+
+  const unsigned char* p=&raw[0];
+  for(int f=0; f<n; f++)
+  {
+    if(bytes==1)
+    {
+      dst[0]=(p[0]-128)<<8;
+      dst[1]=channels>1 ? (p[1]-128)<<8 : dst[0];
+    }
+    else
+    {
+      dst[0]=(short)read_u16(p);
+      dst[1]=channels>1 ? (short)read_u16(p+2) : dst[0];
+    }
+    p+=frame_bytes;
+    dst+=2;
+  }
+  return n;
+}
+
+// next ADPCM block into block; 0 at the end of the data
+int sound_decoder::decode_block()
+{
+  long left=data_size-data_pos;
+  int size=left<block_align ? left : block_align;
+  if(size<=4*channels || !read_bytes(&raw[0],size))
+    return 0;
+  data_pos+=size;
+  int frames=(size-4*channels)*2/channels+1;
+  if(frames>block_frames)
+    frames=block_frames;
+
+  // each channel: first sample and step index, then groups of 4 bytes
+  // holding 8 samples, low nibble first, the channels taking turns
+  int used=channels>2 ? 2 : channels;
+  for(int c=0; c<used; c++)
+  {
+    const unsigned char* h=&raw[4*c];
+    int sample=(short)read_u16(h);
+    int index=h[2]>88 ? 88 : h[2];
+    int* out=&block[c];
+    *out=sample;
+    out+=2;
+    for(int f=1; f<frames; f++)
+    {
+      int group=(f-1)/8;
+      int in_group=(f-1)%8;
+      int nibble=raw[4*channels+group*4*channels+c*4+in_group/2];
+      nibble=in_group&1 ? nibble>>4 : nibble&15;
+
+      int step=ima_step[index];
+      int diff=step>>3;
+      if(nibble&1)
+        diff+=step>>2;
+      if(nibble&2)
+        diff+=step>>1;
+      if(nibble&4)
+        diff+=step;
+      sample+=nibble&8 ? -diff : diff;
+      if(sample>32767)
+        sample=32767;
+      if(sample<-32768)
+        sample=-32768;
+      index+=ima_index[nibble];
+      if(index<0)
+        index=0;
+      if(index>88)
+        index=88;
+      *out=sample;
+      out+=2;
+    }
+  }
+  if(used==1)
+    for(int f=0; f<frames; f++)
+      block[f*2+1]=block[f*2];
+  block_count=frames;
+  block_pos=0;
+  return 1;
+}
+
+// next Ogg packet into block; 0 at the end of the stream
+int sound_decoder::decode_ogg()
+{
+#ifdef USE_TREMOR
+  int bitstream;
+  long n=ov_read(&ogg,(char*)&raw[0],raw.size(),&bitstream);
+  if(n<=0)
+    return 0;
+  const short* p=(const short*)&raw[0];
+  int frames=n/(2*channels);
+  if(frames*2>block.size())
+    frames=block.size()/2;
+  for(int f=0; f<frames; f++)
+  {
+    block[f*2]=p[0];
+    block[f*2+1]=channels>1 ? p[1] : p[0];
+    p+=channels;
+  }
+  block_count=frames;
+  block_pos=0;
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+// up to frames stereo frames into dst; 0 at the end
+int sound_decoder::read(int* dst, int frames)
+{
+  if(type==DECODER_PCM)
+    return read_pcm(dst,frames);
+  if(type!=DECODER_ADPCM && type!=DECODER_OGG)
+    return 0;
+  if(block_pos>=block_count)
+    if(!(type==DECODER_ADPCM ? decode_block() : decode_ogg()))
+      return 0;
+  int n=block_count-block_pos;
+  if(n>frames)
+    n=frames;
+  memcpy(dst,&block[block_pos*2],n*2*sizeof(int));
+  block_pos+=n;
+  return n;
+}
+
+// back to the first frame; 0 if the file cannot seek
+int sound_decoder::restart()
+{
+  block_count=0;
+  block_pos=0;
+#ifdef USE_TREMOR
+  if(type==DECODER_OGG)
+    return ov_pcm_seek(&ogg,0)==0;
+#endif
+  data_pos=0;
+  return seek_to(data_start);
+}
@@ -0,0 +1,309 @@
+#include <cstring>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "../inc/atomic.h"
+#include "../inc/sound_mixer.h"
+
+///////////////////////////////////
+/*  Sample loops                 */
+///////////////////////////////////
+// acc+=in*volume/128 over n samples
+static void add_samples(int* acc, const short* in, int n, int volume)
+{
+  int i=0;
+#ifdef __SSE2__
+  __m128i v=_mm_set1_epi16((short)volume);
+  for(; i+8<=n; i+=8)
+  {
+    __m128i s=_mm_loadu_si128((const __m128i*)(in+i));
+    __m128i lo=_mm_mullo_epi16(s,v);
+    __m128i hi=_mm_mulhi_epi16(s,v);
+    __m128i a=_mm_srai_epi32(_mm_unpacklo_epi16(lo,hi),7);
+    __m128i b=_mm_srai_epi32(_mm_unpackhi_epi16(lo,hi),7);
+    _mm_storeu_si128((__m128i*)(acc+i),_mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc+i)),a));
+    _mm_storeu_si128((__m128i*)(acc+i+4),_mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc+i+4)),b));
+  }
+#endif
+  for(; i<n; i++)
+    acc[i]+=in[i]*volume>>7;
+}
+
+// out+=acc over n samples, clipped to 16 bits
+static void store_samples(short* out, const int* acc, int n)
+{
+  int i=0;
+#ifdef __SSE2__
+  for(; i+8<=n; i+=8)
+  {
+    __m128i o=_mm_loadu_si128((const __m128i*)(out+i));
+    __m128i a=_mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc+i)),_mm_srai_epi32(_mm_unpacklo_epi16(o,o),16));
+    __m128i b=_mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc+i+4)),_mm_srai_epi32(_mm_unpackhi_epi16(o,o),16));
+    _mm_storeu_si128((__m128i*)(out+i),_mm_packs_epi32(a,b));
+  }
+#endif
+  for(; i<n; i++)
+  {
+    int v=out[i]+acc[i];
+    if(v>32767)
+      v=32767;
+    if(v<-32768)
+      v=-32768;
+    out[i]=v;
+  }
+}
+
+sound_mixer::sound_mixer()
+{
+  channels=2;
+  clock=0;
+  active=0;
+  plays=0;
+  coalesced=0;
+  stolen=0;
+  dropped=0;
+  lost=0;
+  voices_peak=0;
+  command_write=0;
+  command_read=0;
+  stops_asked=0;
+  stops_done=0;
+  for(int s=0; s<MIXER_SOUNDS; s++)
+  {
+    sounds[s].priority=0;
+    sounds[s].interval=0;
+    sounds[s].last=0;
+    sounds[s].played=0;
+  }
+  stop_all();
+}
+
+sound_mixer::~sound_mixer()
+{
+}
+
+// 1 or 2 channels of 16-bit samples, what the sounds are set in
+void sound_mixer::open(int out_ch)
+{
+  stop_all();
+  channels=out_ch;
+}
+
+// pcm is taken, left empty; interval in frames, 0 for none
+void sound_mixer::set(int id, std::vector<short>& pcm, int priority, int interval)
+{
+  sounds[id].pcm.swap(pcm);
+  pcm.clear();
+  sounds[id].priority=priority;
+  sounds[id].interval=interval;
+  sounds[id].played=0;
+}
+
+int sound_mixer::loaded(int id)
+{
+  return sounds[id].pcm.size()>0;
+}
+
+///////////////////////////////////
+/*  Commands                     */
+///////////////////////////////////
+void sound_mixer::queue(int type, int id, int value, int loops)
+{
+  int w=command_write;
+  if(w-atomic_get(&command_read)>=MIXER_COMMANDS)
+  {
+    lost++;
+    return;
+  }
+  command& c=commands[w&(MIXER_COMMANDS-1)];
+  c.type=type;
+  c.sound=id;
+  c.value=value;
+  c.loops=loops;
+  atomic_set(&command_write,w+1);
+}
+
+// loops as Mix_PlayChannel() takes them: 0 once, -1 for ever
+void sound_mixer::play(int id, int volume, int loops)
+{
+  queue(MIXER_PLAY,id,volume,loops);
+}
+
+void sound_mixer::stop(int id)
+{
+  queue(MIXER_STOP,id,0,0);
+}
+
+// 0-128, for the voices playing id
+void sound_mixer::volume(int id, int volume)
+{
+  queue(MIXER_VOLUME,id,volume,0);
+}
+
+// times the voices playing id still go back to the start, -1 for ever
+void sound_mixer::loops(int id, int loops)
+{
+  queue(MIXER_LOOPS,id,0,loops);
+}
+
+// audio thread: the commands queued since the last call
+void sound_mixer::run_commands()
+{
+  int r=command_read;
+  int w=atomic_get(&command_write);
+  for(; r!=w; r++)
+  {
+    command& c=commands[r&(MIXER_COMMANDS-1)];
+    if(c.type==MIXER_PLAY)
+      start(c.sound,c.value,c.loops);
+    for(int v=0; v<MIXER_VOICES; v++)
+      if(pool[v].sound==c.sound)
+        switch(c.type)
+        {
+          case MIXER_STOP:
+            pool[v].sound=-1;
+            break;
+          case MIXER_VOLUME:
+            pool[v].volume=c.value;
+            break;
+          case MIXER_LOOPS:
+            pool[v].loops=c.loops;
+            break;
+        }
+  }
+  atomic_set(&command_read,r);
+}
+
+///////////////////////////////////
+/*  Voices                       */
+///////////////////////////////////
+// a free voice, or the one a sound of this priority may take; -1 if none
+int sound_mixer::find_voice(int priority)
+{
+  int best=-1;
+  for(int v=0; v<MIXER_VOICES; v++)
+  {
+    if(pool[v].sound<0)
+      return v;
+    if(best<0 || pool[v].priority<pool[best].priority ||
+       (pool[v].priority==pool[best].priority && clock-pool[v].start>clock-pool[best].start))
+      best=v;
+  }
+  return pool[best].priority<=priority ? best : -1;
+}
+
+void sound_mixer::start(int id, int volume, int loops)
+{
+  sound& s=sounds[id];
+  if(s.pcm.empty())
+    return;
+  plays++;
+  if(s.played && clock-s.last<s.interval)
+  {
+    // the newest voice of it, as loud as the louder of the two
+    int newest=-1;
+    for(int v=0; v<MIXER_VOICES; v++)
+      if(pool[v].sound==id && (newest<0 || clock-pool[v].start<clock-pool[newest].start))
+        newest=v;
+    if(newest>=0 && pool[newest].volume<volume)
+      pool[newest].volume=volume;
+    coalesced++;
+    return;
+  }
+
+  int v=find_voice(s.priority);
+  if(v<0)
+  {
+    dropped++;
+    return;
+  }
+  if(pool[v].sound>=0)
+    stolen++;
+  pool[v].sound=id;
+  pool[v].pos=0;
+  pool[v].volume=volume;
+  pool[v].loops=loops;
+  pool[v].priority=s.priority;
+  pool[v].start=clock;
+  s.last=clock;
+  s.played=1;
+}
+
+// what was queued is dropped too, by the next mix()
+void sound_mixer::stop_all()
+{
+  atomic_add(&stops_asked,1);
+}
+
+///////////////////////////////////
+/*  Mixing                       */
+///////////////////////////////////
+// audio thread: the voices added into out, a block at a time
+void sound_mixer::mix(short* out, int frames)
+{
+  int stops=atomic_get(&stops_asked);
+  if(stops!=stops_done)
+  {
+    for(int v=0; v<MIXER_VOICES; v++)
+      pool[v].sound=-1;
+    atomic_set(&command_read,atomic_get(&command_write));
+    stops_done=stops;
+  }
+  run_commands();
+  int peak=0;
+  while(frames>0)
+  {
+    int n=frames<MIXER_BLOCK ? frames : MIXER_BLOCK;
+    int samples=n*channels;
+    int playing=0;
+    for(int v=0; v<MIXER_VOICES; v++)
+    {
+      voice& vc=pool[v];
+      if(vc.sound<0)
+        continue;
+      if(playing++==0)
+        memset(acc,0,samples*sizeof(int));
+      const std::vector<short>& pcm=sounds[vc.sound].pcm;
+      int at=0;
+      while(at<samples && vc.sound>=0)
+      {
+        int k=pcm.size()-vc.pos;
+        if(k>samples-at)
+          k=samples-at;
+        add_samples(acc+at,&pcm[vc.pos],k,vc.volume);
+        at+=k;
+        vc.pos+=k;
+        if(vc.pos>=pcm.size())
+        {
+          vc.pos=0;
+          if(vc.loops==0)
+            vc.sound=-1;
+          else if(vc.loops>0)
+            vc.loops--;
+        }
+      }
+    }
+    if(playing>0)
+      store_samples(out,acc,samples);
+    if(playing>peak)
+      peak=playing;
+    out+=samples;
+    frames-=n;
+    clock+=n;
+  }
+
+  int now=0;
+  for(int v=0; v<MIXER_VOICES; v++)
+    if(pool[v].sound>=0)
+      now++;
+  active=now;
+  if(peak>voices_peak)
+    voices_peak=peak;
+}
+
+// voices playing; any thread
+int sound_mixer::voices()
+{
+  return active;
+}
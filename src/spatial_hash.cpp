@@ -0,0 +1,208 @@
+#include <vector>
+#include <algorithm>
+#include "../inc/entity.h"
+#include "../inc/spatial_hash.h"
+
+spatial_hash::spatial_hash(int x, int y, int w, int h, int cell)
+{
+  origin_x=x;
+  origin_y=y;
+  cell_size=cell;
+  cols=(w+cell-1)/cell;
+  rows=(h+cell-1)/cell;
+  cell_head.resize(cols*rows,-1);
+  count=0;
+}
+
+spatial_hash::~spatial_hash()
+{
+}
+
+int spatial_hash::cell_of(int x, int y)
+{
+  int cx=(x-origin_x)/cell_size;
+  int cy=(y-origin_y)/cell_size;
+  if(x<origin_x)
+    cx=0;
+  if(cx>=cols)
+    cx=cols-1;
+  if(y<origin_y)
+    cy=0;
+  if(cy>=rows)
+    cy=rows-1;
+  return cy*cols+cx;
+}
+
+void spatial_hash::link(int id, int cell)
+{
+  entry_cell[id]=cell;
+  entry_prev[id]=-1;
+  entry_next[id]=cell_head[cell];
+  if(cell_head[cell]>=0)
+    entry_prev[cell_head[cell]]=id;
+  cell_head[cell]=id;
+}
+
+void spatial_hash::unlink(int id)
+{
+  int cell=entry_cell[id];
+  if(entry_prev[id]>=0)
+    entry_next[entry_prev[id]]=entry_next[id];
+  else
+    cell_head[cell]=entry_next[id];
+  if(entry_next[id]>=0)
+    entry_prev[entry_next[id]]=entry_prev[id];
+  entry_cell[id]=-1;
+}
+
+void spatial_hash::clear()
+{
+  for(int f=0; f<cell_head.size(); f++)
+    cell_head[f]=-1;
+  for(int f=0; f<entry_cell.size(); f++)
+    entry_cell[f]=-1;
+  count=0;
+}
+
+void spatial_hash::insert(int handle, int x, int y)
+{
+  int id=ENTITY_SLOT(handle);
+  if(id>=entry_cell.size())
+  {
+    entry_next.resize(id+1,-1);
+    entry_prev.resize(id+1,-1);
+    entry_cell.resize(id+1,-1);
+    entry_handle.resize(id+1,-1);
+    entry_x.resize(id+1,0);
+    entry_y.resize(id+1,0);
+  }
+  if(entry_cell[id]>=0)
+    unlink(id);
+  else
+    count++;
+  entry_handle[id]=handle;
+  entry_x[id]=x;
+  entry_y[id]=y;
+  link(id,cell_of(x,y));
+}
+
+void spatial_hash::move(int handle, int x, int y)
+{
+  int id=ENTITY_SLOT(handle);
+  if(id>=entry_cell.size() || entry_cell[id]<0)
+  {
+    insert(handle,x,y);
+    return;
+  }
+  entry_handle[id]=handle;
+  entry_x[id]=x;
+  entry_y[id]=y;
+  int cell=cell_of(x,y);
+  if(cell!=entry_cell[id])
+  {
+    unlink(id);
+    link(id,cell);
+  }
+}
+
+void spatial_hash::remove(int handle)
+{
+  int id=ENTITY_SLOT(handle);
+  if(id<entry_cell.size() && entry_cell[id]>=0 && entry_handle[id]==handle)
+  {
+    unlink(id);
+    count--;
+  }
+}
+
+int spatial_hash::size()
+{
+  return count;
+}
+
+// handles whose position lies inside [x0,x1]x[y0,y1], both ends included
+int spatial_hash::query_rect(int x0, int y0, int x1, int y1, std::vector<int>& result)
+{
+  result.clear();
+  int c0=cell_of(x0,y0);
+  int c1=cell_of(x1,y1);
+  for(int cy=c0/cols; cy<=c1/cols; cy++)
+  {
+    for(int cx=c0%cols; cx<=c1%cols; cx++)
+    {
+      for(int id=cell_head[cy*cols+cx]; id>=0; id=entry_next[id])
+      {
+        if(entry_x[id]>=x0 && entry_x[id]<=x1 && entry_y[id]>=y0 && entry_y[id]<=y1)
+          result.push_back(entry_handle[id]);
+      }
+    }
+  }
+  return result.size();
+}
+
+// handles of w x h boxes overlapping a w x h box placed at x,y
+int spatial_hash::query_overlap(int x, int y, int w, int h, std::vector<int>& result)
+{
+  return query_rect(x-w+1,y-h+1,x+w-1,y+h-1,result);
+}
+
+struct nearest_entry
+{
+  int dist;
+  int handle;
+  bool operator<(const nearest_entry& other) const
+  {
+    return dist<other.dist;
+  }
+};
+
+// up to k handles nearest to x,y, closest first
+int spatial_hash::query_nearest(int x, int y, int k, std::vector<int>& result)
+{
+  result.clear();
+  if(k<=0 || count==0)
+    return 0;
+
+  std::vector<nearest_entry> found;
+  int c=cell_of(x,y);
+  int ccx=c%cols;
+  int ccy=c/cols;
+  int max_ring=std::max(cols,rows);
+  for(int r=0; r<=max_ring; r++)
+  {
+    // cells at Chebyshev distance r from the centre cell
+    for(int cy=ccy-r; cy<=ccy+r; cy++)
+    {
+      if(cy<0 || cy>=rows)
+        continue;
+      int step=(cy==ccy-r || cy==ccy+r) ? 1 : 2*r;
+      for(int cx=ccx-r; cx<=ccx+r; cx+=(step>0 ? step : 1))
+      {
+        if(cx<0 || cx>=cols)
+          continue;
+        for(int id=cell_head[cy*cols+cx]; id>=0; id=entry_next[id])
+        {
+          nearest_entry e;
+          int dx=entry_x[id]-x;
+          int dy=entry_y[id]-y;
+          e.dist=dx*dx+dy*dy;
+          e.handle=entry_handle[id];
+          found.push_back(e);
+        }
+      }
+    }
+    // anything in ring r+1 is at least r cells away
+    if(found.size()>=k)
+    {
+      std::nth_element(found.begin(),found.begin()+k-1,found.end());
+      int reach=r*cell_size;
+      if(found[k-1].dist<=reach*reach)
+        break;
+    }
+  }
+
+  std::sort(found.begin(),found.end());
+  for(int f=0; f<found.size() && f<k; f++)
+    result.push_back(found[f].handle);
+  return result.size();
+}
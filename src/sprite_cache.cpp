@@ -0,0 +1,214 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <SDL/SDL.h>
+#include "../inc/sprite_cache.h"
+
+static long read_u32(const unsigned char* p)
+{
+  return (long)p[0]|((long)p[1]<<8)|((long)p[2]<<16)|((long)p[3]<<24);
+}
+
+static void put_u32(std::vector<unsigned char>& out, long v)
+{
+  out.push_back(v&0xff);
+  out.push_back((v>>8)&0xff);
+  out.push_back((v>>16)&0xff);
+  out.push_back((v>>24)&0xff);
+}
+
+// FNV-1a, 32 bits
+unsigned int fnv_hash(const void* data, long size)
+{
+  const unsigned char* p=(const unsigned char*)data;
+  unsigned int h=2166136261u;
+  for(long f=0; f<size; f++)
+  {
+    h^=p[f];
+    h*=16777619u;
+  }
+  return h;
+}
+
+sprite_cache::sprite_cache()
+{
+  data=NULL;
+  size=0;
+  count=0;
+  misses=0;
+}
+
+sprite_cache::~sprite_cache()
+{
+}
+
+// a cache already in memory, kept there while sprites are taken from it;
+// 0 if it is not one or was cooked for another pixel format
+int sprite_cache::open(const void* bytes, long bytes_size, SDL_PixelFormat* format)
+{
+  data=NULL;
+  count=0;
+  const unsigned char* p=(const unsigned char*)bytes;
+  if(!p || bytes_size<CACHE_HEADER || memcmp(p,CACHE_MAGIC,4) || read_u32(p+4)!=CACHE_VERSION)
+    return 0;
+  if(read_u32(p+12)!=format->BitsPerPixel || (Uint32)read_u32(p+16)!=format->Rmask ||
+     (Uint32)read_u32(p+20)!=format->Gmask || (Uint32)read_u32(p+24)!=format->Bmask ||
+     (Uint32)read_u32(p+28)!=SDL_MapRGB(format,255,0,255))
+    return 0;
+  long n=read_u32(p+8);
+  if(n<0 || n>(bytes_size-CACHE_HEADER)/CACHE_ENTRY)
+    return 0;
+  data=p;
+  size=bytes_size;
+  count=n;
+  return 1;
+}
+
+int sprite_cache::open(const char* path, SDL_PixelFormat* format)
+{
+  FILE* f=fopen(path,"rb");
+  if(!f)
+    return 0;
+  fseek(f,0,SEEK_END);
+  long n=ftell(f);
+  fseek(f,0,SEEK_SET);
+  file.resize(n>0 ? n : 1);
+  int ok=n>0 && fread(&file[0],n,1,f)==1;
+  fclose(f);
+  return ok && open(&file[0],n,format);
+}
+
+// the entry, its pixels and mask checked to lie in the cache; NULL if none
+const unsigned char* sprite_cache::find(const char* name, int slice, unsigned int hash)
+{
+  for(int f=0; f<count; f++)
+  {
+    const unsigned char* e=data+CACHE_HEADER+f*CACHE_ENTRY;
+    if(e[CACHE_NAME-1]!=0 || strcmp((const char*)e,name) || read_u32(e+CACHE_NAME)!=slice ||
+       (unsigned int)read_u32(e+CACHE_NAME+4)!=hash)
+      continue;
+    long w=read_u32(e+CACHE_NAME+8);
+    long h=read_u32(e+CACHE_NAME+12);
+    long pixels=read_u32(e+CACHE_NAME+16);
+    long mask=read_u32(e+CACHE_NAME+20);
+    long bytes=(read_u32(data+12)+7)/8;
+    if(w<=0 || h<=0 || w>4096 || h>4096 || pixels<0 || pixels>size || w*h*bytes>size-pixels ||
+       mask<0 || mask>size || (mask && h*8>size-mask))
+      return NULL;
+    return e;
+  }
+  return NULL;
+}
+
+// the sprite and, if asked, its mask; NULL if it has to be cooked
+SDL_Surface* sprite_cache::get(const char* name, int slice, unsigned int hash, collision_mask* m)
+{
+  const unsigned char* e=data ? find(name,slice,hash) : NULL;
+  if(!e || (m && !read_u32(e+CACHE_NAME+20)))
+  {
+    misses++;
+    return NULL;
+  }
+  int w=read_u32(e+CACHE_NAME+8);
+  int h=read_u32(e+CACHE_NAME+12);
+  const unsigned char* pixels=data+read_u32(e+CACHE_NAME+16);
+  SDL_Surface* sprite=SDL_CreateRGBSurface(SDL_SRCCOLORKEY,w,h,read_u32(data+12),0,0,0,0);
+  if(!sprite)
+    return NULL;
+  int row=w*sprite->format->BytesPerPixel;
+  SDL_LockSurface(sprite);
+  for(int y=0; y<h; y++)
+    memcpy((Uint8*)sprite->pixels+y*sprite->pitch,pixels+y*row,row);
+  SDL_UnlockSurface(sprite);
+  SDL_SetColorKey(sprite,SDL_SRCCOLORKEY,read_u32(data+28));
+
+  if(m)
+  {
+    const unsigned char* bits=data+read_u32(e+CACHE_NAME+20);
+    m->create(w,h);
+    for(int y=0; y<h; y++)
+      m->set_row(y,(mask_row)(Uint32)read_u32(bits+y*8)|((mask_row)(Uint32)read_u32(bits+y*8+4)<<32));
+  }
+  add(name,slice,hash,sprite,m);
+  return sprite;
+}
+
+// a sprite for the next cache written
+void sprite_cache::add(const char* name, int slice, unsigned int hash, SDL_Surface* sprite, collision_mask* m)
+{
+  if(!sprite || strlen(name)>=CACHE_NAME)
+    return;
+  cooked c;
+  c.name=name;
+  c.slice=slice;
+  c.hash=hash;
+  c.w=sprite->w;
+  c.h=sprite->h;
+  int row=sprite->w*sprite->format->BytesPerPixel;
+  c.pixels.resize(row*sprite->h);
+  SDL_LockSurface(sprite);
+  for(int y=0; y<sprite->h; y++)
+    memcpy(&c.pixels[y*row],(Uint8*)sprite->pixels+y*sprite->pitch,row);
+  SDL_UnlockSurface(sprite);
+  if(m)
+    for(int y=0; y<sprite->h; y++)
+      c.mask.push_back(m->row(y));
+  out.push_back(c);
+}
+
+// done with the cache read and the sprites added
+void sprite_cache::close()
+{
+  std::vector<unsigned char>().swap(file);
+  std::vector<cooked>().swap(out);
+  data=NULL;
+  size=0;
+  count=0;
+}
+
+// every sprite added, cooked for format
+int sprite_cache::write(const char* path, SDL_PixelFormat* format)
+{
+  std::vector<unsigned char> head;
+  head.insert(head.end(),(const unsigned char*)CACHE_MAGIC,(const unsigned char*)CACHE_MAGIC+4);
+  put_u32(head,CACHE_VERSION);
+  put_u32(head,out.size());
+  put_u32(head,format->BitsPerPixel);
+  put_u32(head,format->Rmask);
+  put_u32(head,format->Gmask);
+  put_u32(head,format->Bmask);
+  put_u32(head,SDL_MapRGB(format,255,0,255));
+
+  std::vector<unsigned char> body;
+  long at=CACHE_HEADER+out.size()*CACHE_ENTRY;
+  for(int f=0; f<out.size(); f++)
+  {
+    cooked& c=out[f];
+    char name[CACHE_NAME];
+    memset(name,0,CACHE_NAME);
+    strcpy(name,c.name.c_str());
+    head.insert(head.end(),(unsigned char*)name,(unsigned char*)name+CACHE_NAME);
+    put_u32(head,c.slice);
+    put_u32(head,c.hash);
+    put_u32(head,c.w);
+    put_u32(head,c.h);
+    put_u32(head,at+body.size());
+    body.insert(body.end(),c.pixels.begin(),c.pixels.end());
+    while(body.size()%4)
+      body.push_back(0);
+    put_u32(head,c.mask.size()>0 ? at+body.size() : 0);
+    for(int y=0; y<c.mask.size(); y++)
+    {
+      put_u32(body,(long)(c.mask[y]&0xffffffff));
+      put_u32(body,(long)(c.mask[y]>>32));
+    }
+  }
+
+  FILE* f=fopen(path,"wb");
+  if(!f)
+    return 0;
+  int ok=fwrite(&head[0],head.size(),1,f)==1 && (body.size()==0 || fwrite(&body[0],body.size(),1,f)==1);
+  fclose(f);
+  return ok;
+}
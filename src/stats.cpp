@@ -0,0 +1,106 @@
+#ifdef PLATFORM_WIN
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+#include <cstddef>
+#include "../inc/stats.h"
+
+long long stats_usec()
+{
+#ifdef PLATFORM_WIN
+  LARGE_INTEGER freq;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&counter);
+  return (counter.QuadPart/freq.QuadPart)*1000000+(counter.QuadPart%freq.QuadPart)*1000000/freq.QuadPart;
+#else
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return (long long)tv.tv_sec*1000000+tv.tv_usec;
+#endif
+}
+
+frame_stats::frame_stats()
+{
+  for(int f=0; f<STAT_COUNT; f++)
+    start[f]=0;
+  reset();
+}
+
+frame_stats::~frame_stats()
+{
+}
+
+void frame_stats::reset()
+{
+  // timers running now keep their start
+  for(int f=0; f<STAT_COUNT; f++)
+  {
+    current[f]=0;
+    total[f]=0;
+    peak[f]=0;
+  }
+  frames=0;
+}
+
+void frame_stats::begin(int id)
+{
+  start[id]=stats_usec();
+}
+
+void frame_stats::end(int id)
+{
+  current[id]+=stats_usec()-start[id];
+}
+
+void frame_stats::next_frame()
+{
+  for(int f=0; f<STAT_COUNT; f++)
+  {
+    total[f]+=current[f];
+    if(current[f]>peak[f])
+      peak[f]=current[f];
+    current[f]=0;
+  }
+  frames++;
+}
+
+int frame_stats::count()
+{
+  return frames;
+}
+
+int frame_stats::average(int id)
+{
+  if(frames==0)
+    return 0;
+  return total[id]/frames;
+}
+
+int frame_stats::maximum(int id)
+{
+  return peak[id];
+}
+
+const char* frame_stats::name(int id)
+{
+  switch(id)
+  {
+    case STAT_FRAME:
+      return "frame";
+    case STAT_UPDATE:
+      return "update";
+    case STAT_DRAW:
+      return "draw";
+    case STAT_EXP:
+      return "exp";
+    case STAT_FILTER:
+      return "filter";
+    case STAT_FLIP:
+      return "flip";
+    case STAT_WAIT:
+      return "wait";
+  }
+  return "";
+}
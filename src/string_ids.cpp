@@ -0,0 +1,30 @@
+// Made by tools/string_ids from lang/English.lang, do not edit.
+#include "../inc/string_ids.h"
+
+const char* const fallback_strings[]=
+{
+  "",
+  "Rafa Vico presents",
+  "Play",
+  "Exit",
+  "Level: %i",
+  "Score: %i",
+  "Bathyscaphe",
+  "END",
+};
+
+const char fallback_formats[]=
+{
+  1,
+  1,
+  1,
+  1,
+  1,
+  1,
+  1,
+  1,
+};
+
+// the tables and the enum fall out of step if either is edited by hand
+typedef char fallback_strings_checked[sizeof(fallback_strings)/sizeof(fallback_strings[0])==STRING_COUNT ? 1 : -1];
+typedef char fallback_formats_checked[sizeof(fallback_formats)==STRING_COUNT ? 1 : -1];
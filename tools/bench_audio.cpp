@@ -0,0 +1,226 @@
+///////////////////////////////////
+/*  Audio decode benchmark       */
+///////////////////////////////////
+// Decode cost of every sound under both policies: decoding it whole when
+// it loads, and decoding it as it plays through a looping stream (given
+// per second of sound). Each WAV in data/ is timed as it is and as an IMA
+// ADPCM copy encoded here; name.ogg next to it is timed too when built
+// with Tremor. Output is 22 kHz stereo like the game's mixer. Build from
+// the repo root:
+//   g++ -O2 -o bench_audio tools/bench_audio.cpp src/audio_stream.cpp src/sound_decoder.cpp
+// and add -DUSE_TREMOR -lvorbisidec for Ogg.
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+#include "../inc/audio_stream.h"
+
+#define RATE        22050
+#define CHANNELS    2
+#define ADPCM_BLOCK 1024            // bytes per channel in a block
+#define ADPCM_FILE  "bench_adpcm.wav"
+
+static const int ima_index[16]=
+{
+  -1,-1,-1,-1,2,4,6,8,
+  -1,-1,-1,-1,2,4,6,8
+};
+
+static const int ima_step[89]=
+{
+  7,8,9,10,11,12,13,14,16,17,19,21,23,25,28,31,34,37,41,45,50,55,60,66,
+  73,80,88,97,107,118,130,143,157,173,190,209,230,253,279,307,337,371,
+  408,449,494,544,598,658,724,796,876,963,1060,1166,1282,1411,1552,1707,
+  1878,2066,2272,2499,2749,3024,3327,3660,4026,4428,4871,5358,5894,6484,
+  7132,7845,8630,9493,10442,11487,12635,13899,15289,16818,18500,20350,
+  22385,24623,27086,29794,32767
+};
+
+void put_u16(std::vector<unsigned char>& out, int v)
+{
+  out.push_back(v&255);
+  out.push_back((v>>8)&255);
+}
+
+void put_u32(std::vector<unsigned char>& out, long v)
+{
+  put_u16(out,v&0xffff);
+  put_u16(out,(v>>16)&0xffff);
+}
+
+int encode_nibble(int sample, int& pred, int& index)
+{
+  int diff=sample-pred;
+  int nibble=0;
+  if(diff<0)
+  {
+    nibble=8;
+    diff=-diff;
+  }
+  int step=ima_step[index];
+  int delta=step>>3;
+  if(diff>=step)
+  {
+    nibble|=4;
+    diff-=step;
+    delta+=step;
+  }
+  step>>=1;
+  if(diff>=step)
+  {
+    nibble|=2;
+    diff-=step;
+    delta+=step;
+  }
+  step>>=1;
+  if(diff>=step)
+  {
+    nibble|=1;
+    delta+=step;
+  }
+  pred+=nibble&8 ? -delta : delta;
+  if(pred>32767)
+    pred=32767;
+  if(pred<-32768)
+    pred=-32768;
+  index+=ima_index[nibble];
+  if(index<0)
+    index=0;
+  if(index>88)
+    index=88;
+  return nibble;
+}
+
+// the sound as a stereo IMA ADPCM WAV; its size in bytes, 0 on failure
+long write_adpcm(const char* from, const char* to)
+{
+  sound_decoder in;
+  if(!in.open(from))
+    return 0;
+  std::vector<int> frames;
+  std::vector<int> buffer(1024*2);
+  int n;
+  while((n=in.read(&buffer[0],1024))>0)
+    frames.insert(frames.end(),buffer.begin(),buffer.begin()+n*2);
+  int count=frames.size()/2;
+
+  int block_align=ADPCM_BLOCK*2;
+  int groups=(block_align-8)/8;
+  int block_frames=groups*8+1;
+  std::vector<unsigned char> data;
+  int pred[2]={0,0};
+  int index[2]={0,0};
+  for(int first=0; first<count; first+=block_frames)
+  {
+    for(int c=0; c<2; c++)
+    {
+      pred[c]=frames[first*2+c];
+      put_u16(data,pred[c]);
+      data.push_back(index[c]);
+      data.push_back(0);
+    }
+    for(int g=0; g<groups && first+1+g*8<count; g++)
+      for(int c=0; c<2; c++)
+        for(int b=0; b<4; b++)
+        {
+          int byte=0;
+          for(int h=0; h<2; h++)
+          {
+            int f=first+1+g*8+b*2+h;
+            int sample=f<count ? frames[f*2+c] : pred[c];
+            byte|=encode_nibble(sample,pred[c],index[c])<<(h*4);
+          }
+          data.push_back(byte);
+        }
+  }
+
+  std::vector<unsigned char> header;
+  header.insert(header.end(),(const unsigned char*)"RIFF",(const unsigned char*)"RIFF"+4);
+  put_u32(header,4+28+8+data.size()+8);
+  header.insert(header.end(),(const unsigned char*)"WAVEfmt ",(const unsigned char*)"WAVEfmt "+8);
+  put_u32(header,20);
+  put_u16(header,0x11);
+  put_u16(header,2);
+  put_u32(header,in.rate());
+  put_u32(header,(long)in.rate()*block_align/block_frames);
+  put_u16(header,block_align);
+  put_u16(header,4);
+  put_u16(header,2);
+  put_u16(header,block_frames);
+  header.insert(header.end(),(const unsigned char*)"data",(const unsigned char*)"data"+4);
+  put_u32(header,data.size());
+
+  FILE* file=fopen(to,"wb");
+  if(!file)
+    return 0;
+  fwrite(&header[0],header.size(),1,file);
+  fwrite(&data[0],data.size(),1,file);
+  fclose(file);
+  return header.size()+data.size();
+}
+
+long file_size(const char* name)
+{
+  FILE* file=fopen(name,"rb");
+  if(!file)
+    return 0;
+  fseek(file,0,SEEK_END);
+  long size=ftell(file);
+  fclose(file);
+  return size;
+}
+
+double ms_since(clock_t start)
+{
+  return double(clock()-start)*1000.0/CLOCKS_PER_SEC;
+}
+
+void bench(const char* label, const char* name)
+{
+  audio_stream stream;
+  std::vector<short> pcm;
+  if(!stream.open(name,RATE,CHANNELS,0))
+    return;
+
+  clock_t start=clock();
+  stream.decode_all(pcm);
+  double load=ms_since(start);
+  int frames=pcm.size()/CHANNELS;
+
+  // 10 seconds of sound as the game mixes it, a callback's worth at a time
+  stream.open(name,RATE,CHANNELS,1);
+  stream.play();
+  std::vector<short> out(1024*CHANNELS);
+  start=clock();
+  for(int done=0; done<RATE*10; done+=1024)
+  {
+    stream.fill();
+    stream.mix(&out[0],1024,128);
+  }
+  double play=ms_since(start)/10;
+
+  printf("%-20s %-6s %9li %9li %10.2f %14.3f\n",label,stream.kind()==DECODER_PCM ? "pcm" : stream.kind()==DECODER_ADPCM ? "adpcm" : "ogg",
+         file_size(name),(long)frames*CHANNELS*2,load,play);
+}
+
+int main(int argc, char *argv[])
+{
+  const char* sounds[]={"bubble","gold","hit","engine","roar","water"};
+
+  printf("sound                kind        file  resident    load ms  play ms per s\n");
+  for(int f=0; f<6; f++)
+  {
+    std::string name=std::string("data/")+sounds[f];
+    std::string wav=name+".wav";
+    bench(sounds[f],wav.c_str());
+    if(write_adpcm(wav.c_str(),ADPCM_FILE))
+      bench(sounds[f],ADPCM_FILE);
+#ifdef USE_TREMOR
+    std::string ogg=name+".ogg";
+    bench(sounds[f],ogg.c_str());
+#endif
+  }
+  remove(ADPCM_FILE);
+  return 0;
+}
@@ -0,0 +1,143 @@
+///////////////////////////////////
+/*  Collision benchmark          */
+///////////////////////////////////
+// Compares brute force bug collision against the spatial hash for growing
+// numbers of bugs moving as in update_game(). First in the game's sea, so
+// the bugs crowd as they grow; then in a sea grown with them, at the
+// density of 1000 bugs in the game's, where a query should cost the same
+// for any number of bugs. Build from the repo root:
+//   g++ -O2 -o bench_collision tools/bench_collision.cpp src/entity.cpp src/spatial_hash.cpp
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include "../inc/entity.h"
+#include "../inc/spatial_hash.h"
+
+#define FRAMES  60
+#define SEA_W   298       // where a bug's corner goes in the game
+#define SEA_H   156
+#define DENSITY 1000      // bugs in the game's sea for the second run
+
+entity_store bug_list(COMP_POS|COMP_DIR);
+spatial_hash* bug_hash=NULL;
+std::vector<int> bug_query;
+int sea_w=SEA_W;
+int sea_h=SEA_H;
+
+void spawn_bugs(int count)
+{
+  bug_list.clear();
+  delete bug_hash;
+  bug_hash=new spatial_hash(0,48,sea_w+22,sea_h+24,16);
+  int first=bug_list.spawn_range(count);
+  for(int i=first; i<bug_list.size(); i++)
+  {
+    bug_list.x[i]=rand()%sea_w;
+    bug_list.y[i]=48+rand()%sea_h;
+    bug_list.dir_x[i]=-1+rand()%3;
+    bug_list.dir_y[i]=rand()%2 ? 1 : -1;
+    bug_hash->insert(bug_list.handle(i),bug_list.x[i],bug_list.y[i]);
+  }
+}
+
+void move_bugs(int hashed)
+{
+  for(int i=0; i<bug_list.size(); i++)
+  {
+    bug_list.x[i]+=bug_list.dir_x[i];
+    bug_list.y[i]+=bug_list.dir_y[i];
+    if(bug_list.x[i]<0 || bug_list.x[i]>sea_w)
+      bug_list.dir_x[i]=-bug_list.dir_x[i];
+    if(bug_list.y[i]<48 || bug_list.y[i]>48+sea_h)
+      bug_list.dir_y[i]=-bug_list.dir_y[i];
+    if(hashed)
+      bug_hash->move(bug_list.handle(i),bug_list.x[i],bug_list.y[i]);
+  }
+}
+
+// bug-bug contacts, every pair tested
+int brute_pairs()
+{
+  int hits=0;
+  int n=bug_list.size();
+  for(int i=0; i<n; i++)
+    for(int j=i+1; j<n; j++)
+      if(abs(bug_list.x[i]-bug_list.x[j])<4 && abs(bug_list.y[i]-bug_list.y[j])<4)
+        hits++;
+  return hits;
+}
+
+// bug-bug contacts through the hash
+int hashed_pairs()
+{
+  int hits=0;
+  for(int i=0; i<bug_list.size(); i++)
+    hits+=bug_hash->query_overlap(bug_list.x[i],bug_list.y[i],4,4,bug_query)-1;
+  return hits/2;
+}
+
+double ms_since(clock_t start)
+{
+  return double(clock()-start)*1000.0/CLOCKS_PER_SEC/FRAMES;
+}
+
+// one line per bug count, the sea grown to keep DENSITY if fixed_density
+void bench(int fixed_density)
+{
+  int counts[]={10,100,1000,2500,5000,10000};
+  srand(1);
+
+  printf(fixed_density ? "\nsea grown with the bugs, %i in the game's sea\n" : "game's sea\n",DENSITY);
+  printf("bugs    sea          brute pairs ms  hash pairs ms  hash move ms  ship query us  nearest(8) us\n");
+  for(int c=0; c<6; c++)
+  {
+    int n=counts[c];
+    int check=0;
+    double scale=fixed_density ? sqrt((double)n/DENSITY) : 1;
+    sea_w=(int)(SEA_W*scale);
+    sea_h=(int)(SEA_H*scale);
+
+    spawn_bugs(n);
+    clock_t start=clock();
+    for(int f=0; f<FRAMES; f++)
+    {
+      move_bugs(0);
+      check+=brute_pairs();
+    }
+    double brute=ms_since(start);
+
+    spawn_bugs(n);
+    start=clock();
+    for(int f=0; f<FRAMES; f++)
+      move_bugs(1);
+    double moves=ms_since(start);
+
+    start=clock();
+    for(int f=0; f<FRAMES; f++)
+      check-=hashed_pairs();
+    double hashed=ms_since(start);
+
+    start=clock();
+    for(int f=0; f<FRAMES*100; f++)
+      check+=bug_hash->query_overlap(rand()%sea_w,48+rand()%sea_h,20,20,bug_query);
+    double ship=ms_since(start)*10.0;
+
+    start=clock();
+    for(int f=0; f<FRAMES*100; f++)
+      check+=bug_hash->query_nearest(rand()%sea_w,48+rand()%sea_h,8,bug_query);
+    double nearest=ms_since(start)*10.0;
+
+    printf("%-7i %4ix%-6i %14.3f  %13.3f  %12.3f  %13.3f  %13.3f\n",n,sea_w,sea_h,brute,hashed,moves,ship,nearest);
+    if(check==0x7fffffff)
+      printf("\n");
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  bench(0);
+  bench(1);
+  return 0;
+}
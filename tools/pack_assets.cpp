@@ -0,0 +1,131 @@
+///////////////////////////////////
+/*  Asset packer                 */
+///////////////////////////////////
+// Writes the files given into one pack the game maps at start, laid out as
+// inc/asset_pack.h describes. Names are kept as given, so pack from the
+// repo root with the paths the game opens, after bathyscaphe -cook:
+//   g++ -O2 -o pack_assets tools/pack_assets.cpp
+//   ./pack_assets data.pak data/*.bmp data/*.wav data/*.ttf data/sprites.cache
+//     data/exp.rules lang/*.lang*
+// With -c the pack is written as C++ source instead, the embedded_pack of
+// inc/embedded_assets.h, for a build with EMBED_ASSETS to start without
+// reading a file. Only what the first minutes need is worth the memory:
+//   ./pack_assets -c src/embedded_assets.cpp `ls data/*.bmp | grep -v icon`
+//     data/pixantiqua.ttf data/sprites.cache data/exp.rules data/bubble.wav
+//     data/gold.wav data/hit.wav data/roar.wav lang/*.lang*
+// The "WIZ embedded" target of bathyscaphe.cbp runs this before it builds,
+// leaving out data/sprites.cache until it has been cooked.
+// The engine and water loops stream from disk as before.
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../inc/asset_pack.h"
+
+void put_u32(std::vector<unsigned char>& out, long v)
+{
+  out.push_back(v&0xff);
+  out.push_back((v>>8)&0xff);
+  out.push_back((v>>16)&0xff);
+  out.push_back((v>>24)&0xff);
+}
+
+int read_file(const std::string& name, std::vector<unsigned char>& data)
+{
+  FILE* file=fopen(name.c_str(),"rb");
+  if(!file)
+    return 0;
+  fseek(file,0,SEEK_END);
+  long size=ftell(file);
+  fseek(file,0,SEEK_SET);
+  data.resize(size);
+  int ok=size==0 || fread(&data[0],size,1,file)==1;
+  fclose(file);
+  return ok;
+}
+
+// the pack as an array, aligned like the mapped file
+int write_source(FILE* file, const std::vector<unsigned char>& pack)
+{
+  fprintf(file,"// Made by tools/pack_assets -c, do not edit.\n");
+  fprintf(file,"#include \"../inc/embedded_assets.h\"\n\n");
+  fprintf(file,"const unsigned char embedded_pack[] __attribute__((aligned(%i)))=\n{",PACK_ALIGN);
+  for(long f=0; f<pack.size(); f++)
+    fprintf(file,"%s%i,",f%24 ? "" : "\n  ",pack[f]);
+  fprintf(file,"\n};\n");
+  fprintf(file,"const long embedded_pack_size=%li;\n",(long)pack.size());
+  return !ferror(file);
+}
+
+int main(int argc, char* argv[])
+{
+  int source=argc>1 && !strcmp(argv[1],"-c");
+  if(argc<3+source)
+  {
+    printf("pack_assets [-c] pack file...\n");
+    return 1;
+  }
+  const char* out=argv[1+source];
+
+  std::vector<std::string> names;
+  for(int f=2+source; f<argc; f++)
+  {
+    std::string name=argv[f];
+    std::replace(name.begin(),name.end(),'\\','/');
+    if(name.size()>=PACK_NAME)
+    {
+      printf("%s: name longer than %i\n",name.c_str(),PACK_NAME-1);
+      return 1;
+    }
+    if(std::find(names.begin(),names.end(),name)==names.end())
+      names.push_back(name);
+  }
+  std::sort(names.begin(),names.end());
+
+  std::vector<unsigned char> index;
+  index.insert(index.end(),(const unsigned char*)PACK_MAGIC,(const unsigned char*)PACK_MAGIC+4);
+  put_u32(index,PACK_VERSION);
+  put_u32(index,names.size());
+  long offset=PACK_HEADER+names.size()*PACK_ENTRY;
+  std::vector<std::vector<unsigned char> > datas(names.size());
+  for(int f=0; f<names.size(); f++)
+  {
+    if(!read_file(names[f],datas[f]))
+    {
+      printf("%s: cannot read\n",names[f].c_str());
+      return 1;
+    }
+    offset=(offset+PACK_ALIGN-1)/PACK_ALIGN*PACK_ALIGN;
+    put_u32(index,offset);
+    put_u32(index,datas[f].size());
+    char name[PACK_NAME];
+    memset(name,0,PACK_NAME);
+    strcpy(name,names[f].c_str());
+    index.insert(index.end(),(unsigned char*)name,(unsigned char*)name+PACK_NAME);
+    offset+=datas[f].size();
+  }
+
+  std::vector<unsigned char> pack(index);
+  for(int f=0; f<names.size(); f++)
+  {
+    pack.resize((pack.size()+PACK_ALIGN-1)/PACK_ALIGN*PACK_ALIGN,0);
+    pack.insert(pack.end(),datas[f].begin(),datas[f].end());
+    printf("%8li  %s\n",(long)datas[f].size(),names[f].c_str());
+  }
+
+  FILE* file=fopen(out,source ? "w" : "wb");
+  if(!file)
+  {
+    printf("%s: cannot write\n",out);
+    return 1;
+  }
+  int ok=source ? write_source(file,pack) : fwrite(&pack[0],pack.size(),1,file)==1;
+  if(fclose(file) || !ok)
+  {
+    printf("%s: cannot write\n",out);
+    return 1;
+  }
+  printf("%i files, %li bytes\n",(int)names.size(),(long)pack.size());
+  return 0;
+}
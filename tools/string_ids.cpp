@@ -0,0 +1,175 @@
+///////////////////////////////////
+/*  String ids                   */
+///////////////////////////////////
+// Writes inc/string_ids.h, an enum naming each string of a language file,
+// and src/string_ids.cpp, its strings as the fallback the game uses with no
+// language to read. Names come from the text, "@4 Level: %i" is
+// STRING_LEVEL. Run from the repo root when the English strings change:
+//   g++ -O2 -o string_ids tools/string_ids.cpp
+//   ./string_ids lang/English.lang inc/string_ids.h src/string_ids.cpp
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// 1 if s converts nothing but, at most once, an int with %i or %d; as the
+// game checks its strings
+int int_format(const char* s)
+{
+  int conversions=0;
+  for(; *s; s++)
+  {
+    if(*s!='%')
+      continue;
+    s++;
+    if(*s=='%')
+      continue;
+    while(*s && strchr("-+ #0",*s))
+      s++;
+    while(*s>='0' && *s<='9')
+      s++;
+    if(*s=='.')
+      s++;
+    while(*s>='0' && *s<='9')
+      s++;
+    if(*s!='i' && *s!='d')
+      return 0;
+    conversions++;
+  }
+  return conversions<=1;
+}
+
+// STRING_ and the words of text, without its conversions
+std::string id_name(const std::string& text, int id)
+{
+  std::string name;
+  for(int f=0; f<text.size(); f++)
+  {
+    if(text[f]=='%')
+    {
+      f++;
+      while(f<text.size() && !isalpha((unsigned char)text[f]) && text[f]!='%')
+        f++;
+      continue;
+    }
+    if(isalnum((unsigned char)text[f]))
+      name+=toupper((unsigned char)text[f]);
+    else if(name.size()>0 && name[name.size()-1]!='_')
+      name+='_';
+  }
+  while(name.size()>0 && name[name.size()-1]=='_')
+    name.erase(name.size()-1);
+  if(name.empty() || isdigit((unsigned char)name[0]))
+  {
+    char number[16];
+    sprintf(number,"%i",id);
+    name=number;
+  }
+  return "STRING_"+name;
+}
+
+// text as a C string literal
+std::string literal(const std::string& text)
+{
+  std::string out="\"";
+  for(int f=0; f<text.size(); f++)
+  {
+    if(text[f]=='"' || text[f]=='\\')
+      out+='\\';
+    out+=text[f];
+  }
+  return out+"\"";
+}
+
+int main(int argc, char* argv[])
+{
+  if(argc<4)
+  {
+    printf("string_ids file.lang header source\n");
+    return 1;
+  }
+  std::ifstream in(argv[1]);
+  if(!in)
+  {
+    printf("%s: cannot read\n",argv[1]);
+    return 1;
+  }
+
+  std::string lang;
+  std::vector<std::string> texts;
+  std::string line;
+  while(std::getline(in,line))
+  {
+    if(line.size()>0 && line[line.size()-1]=='\r')
+      line.erase(line.size()-1);
+    int i=line.find(' ');
+    if(line.size()<2 || line[0]!='@' || i==std::string::npos)
+      continue;
+    std::string code=line.substr(1,i-1);
+    std::string text=line.substr(i+1);
+    if(code=="lang")
+      lang=text;
+    if(code.empty() || code.find_first_not_of("0123456789")!=std::string::npos)
+      continue;
+    int id=atoi(code.c_str());
+    if(id>=texts.size())
+      texts.resize(id+1);
+    texts[id]=text;
+  }
+
+  std::vector<std::string> names(texts.size());
+  for(int f=1; f<texts.size(); f++)
+  {
+    names[f]=id_name(texts[f],f);
+    for(int g=1; g<f; g++)
+      if(names[g]==names[f])
+      {
+        char number[16];
+        sprintf(number,"_%i",f);
+        names[f]+=number;
+      }
+  }
+
+  FILE* header=fopen(argv[2],"w");
+  if(!header)
+  {
+    printf("%s: cannot write\n",argv[2]);
+    return 1;
+  }
+  fprintf(header,"// Made by tools/string_ids from %s, do not edit.\n",argv[1]);
+  fprintf(header,"#ifndef STRING_IDS_H\n#define STRING_IDS_H\n\n");
+  fprintf(header,"#define FALLBACK_LANGUAGE %s\n\n",literal(lang).c_str());
+  fprintf(header,"enum string_id\n{\n");
+  for(int f=1; f<texts.size(); f++)
+    fprintf(header,"  %s=%i,\n",names[f].c_str(),f);
+  fprintf(header,"  STRING_COUNT=%i\n};\n\n",(int)texts.size());
+  fprintf(header,"// the strings of %s by id, and 1 for those safe as a format for one int\n",argv[1]);
+  fprintf(header,"extern const char* const fallback_strings[];\n");
+  fprintf(header,"extern const char fallback_formats[];\n\n#endif\n");
+  fclose(header);
+
+  FILE* source=fopen(argv[3],"w");
+  if(!source)
+  {
+    printf("%s: cannot write\n",argv[3]);
+    return 1;
+  }
+  fprintf(source,"// Made by tools/string_ids from %s, do not edit.\n",argv[1]);
+  fprintf(source,"#include \"../inc/string_ids.h\"\n\n");
+  fprintf(source,"const char* const fallback_strings[]=\n{\n");
+  for(int f=0; f<texts.size(); f++)
+    fprintf(source,"  %s,\n",literal(texts[f]).c_str());
+  fprintf(source,"};\n\nconst char fallback_formats[]=\n{\n");
+  for(int f=0; f<texts.size(); f++)
+    fprintf(source,"  %i,\n",int_format(texts[f].c_str()));
+  fprintf(source,"};\n\n");
+  fprintf(source,"// the tables and the enum fall out of step if either is edited by hand\n");
+  fprintf(source,"typedef char fallback_strings_checked[sizeof(fallback_strings)/sizeof(fallback_strings[0])==STRING_COUNT ? 1 : -1];\n");
+  fprintf(source,"typedef char fallback_formats_checked[sizeof(fallback_formats)==STRING_COUNT ? 1 : -1];\n");
+  fclose(source);
+  printf("%i strings\n",(int)texts.size()-1);
+  return 0;
+}